@@ -0,0 +1,74 @@
+#ifndef _ALLOC_H_
+#define _ALLOC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Allocation of the packed sieve arrays
+ *
+ * Large arrays are mapped on huge pages: reserved ones (MAP_HUGETLB, see
+ * vm.nr_hugepages) when the kernel has enough of them, transparent ones
+ * (madvise(MADV_HUGEPAGE) on a 2 MB aligned mapping) otherwise. Nothing is
+ * touched here: the pages are placed by the first thread that writes them,
+ * i.e. the worker sieving that region.
+ *
+ * On multi-socket hosts the workers can also be pinned to the cpus of one
+ * node each and their region of the array bound to that node (mbind), so
+ * that the threads never sieve remote memory. Without libnuma: the nodes are
+ * read from /sys/devices/system/node and mbind() is called through syscall().
+ */
+
+/**
+ * @brief Array of size bytes for the sieve, uninitialised
+ * @return NULL if the memory could not be allocated
+ */
+void *sieve_alloc(uint64_t size);
+
+/**
+ * @brief Release an array of sieve_alloc(), or of malloc()
+ */
+void sieve_free(void *p);
+
+/**
+ * @return number of NUMA nodes of the host, 1 when it has no NUMA information
+ */
+int alloc_node_count(void);
+
+/**
+ * @brief Node of worker id out of n_workers: consecutive workers share a node
+ */
+int alloc_worker_node(int id, int n_workers);
+
+/**
+ * @brief Cpu affinity of a thread before alloc_bind_thread(), room for the 1024 cpus of a cpu_set_t
+ */
+typedef struct
+{
+    unsigned long mask[1024 / (8 * sizeof(unsigned long))];
+    bool saved;
+} alloc_affinity;
+
+/**
+ * @brief Pin the calling thread to the cpus of node
+ * @param saved set to the previous affinity, to give back with alloc_restore_thread(); NULL when the thread exits pinned
+ * @return 0 on success, -1 if the node or its cpus are unknown
+ */
+int alloc_bind_thread(int node, alloc_affinity *saved);
+
+/**
+ * @brief Give the calling thread back the affinity it had before alloc_bind_thread()
+ *
+ * Needed by the threads of a pool that outlives the run, as the OpenMP one.
+ */
+void alloc_restore_thread(const alloc_affinity *saved);
+
+/**
+ * @brief Ask the pages of [p, p + size) to be allocated on node
+ *
+ * Only the pages entirely in the range are bound and they must not have been
+ * touched yet. Best effort: nothing happens when the kernel refuses.
+ */
+void alloc_place(void *p, uint64_t size, int node);
+
+#endif
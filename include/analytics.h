@@ -0,0 +1,121 @@
+#ifndef _ANALYTICS_H_
+#define _ANALYTICS_H_
+
+#include "sieve.h"
+#include "segment.h"
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**
+ * @brief Prime statistics gathered in the segment loop: constellations and gaps
+ *
+ * Each segment is scanned right after sieve_segment(), while it is still in
+ * cache, so the statistics cost no second pass over the primes. The range is
+ * cut in parts, one sieve_analytics each: threads and MPI ranks fill their
+ * parts independently and analytics_merge() joins neighbours. A part keeps its
+ * primes within ANALYTICS_WIDTH of either end, so the gap and the
+ * constellations across a boundary are counted when the parts meet.
+ *
+ * Constellations are counted by their first prime, all of it in the range:
+ * twin, cousin and sexy pairs (p, p + 2 / 4 / 6), and the admissible k-tuples
+ * of minimal width for k = 3 to 6. The gaps go to a histogram and to the list
+ * of maximal gaps, each larger than every gap before it in the range.
+ */
+
+/** Widest constellation counted: the sextuplet (0, 4, 6, 10, 12, 16) */
+#define ANALYTICS_WIDTH 16
+/** Primes kept at each end of a part: at most 7 fit in 17 consecutive numbers */
+#define ANALYTICS_EDGE 8
+/** Gap histogram bins: bin g counts the gaps of g, the last bin every longer one (none below 2^64) */
+#define ANALYTICS_MAX_GAP 2048
+/** Room for the maximal gaps: they grow by at least 2 and stay below ANALYTICS_MAX_GAP */
+#define ANALYTICS_MAX_RECORDS (ANALYTICS_MAX_GAP / 2 + 1)
+/** Parts per thread: the threads take them from a work-stealing scheduler */
+#define ANALYTICS_PARTS_PER_THREAD 8
+
+typedef enum
+{
+    ANALYTICS_TWIN,         // (0, 2)
+    ANALYTICS_COUSIN,       // (0, 4)
+    ANALYTICS_SEXY,         // (0, 6)
+    ANALYTICS_TRIPLET_A,    // (0, 2, 6)
+    ANALYTICS_TRIPLET_B,    // (0, 4, 6)
+    ANALYTICS_QUADRUPLET,   // (0, 2, 6, 8)
+    ANALYTICS_QUINTUPLET_A, // (0, 2, 6, 8, 12)
+    ANALYTICS_QUINTUPLET_B, // (0, 4, 6, 10, 12)
+    ANALYTICS_SEXTUPLET,    // (0, 4, 6, 10, 12, 16)
+    ANALYTICS_PATTERN_COUNT
+} analytics_pattern;
+
+typedef struct
+{
+    uint64_t prime; // the gap starts here
+    uint64_t gap;   // the next prime is prime + gap
+} analytics_record;
+
+typedef struct sieve_analytics
+{
+    uint64_t count;
+    uint64_t first;  // smallest prime of the part, 0 if it has none
+    uint64_t last;   // largest prime of the part
+    uint32_t recent; // bit i set when last - i is prime, i <= ANALYTICS_WIDTH
+    uint64_t patterns[ANALYTICS_PATTERN_COUNT];
+    uint64_t gaps[ANALYTICS_MAX_GAP];
+    analytics_record records[ANALYTICS_MAX_RECORDS];
+    int n_records;
+    uint64_t head[ANALYTICS_EDGE]; // primes <= first + ANALYTICS_WIDTH
+    int n_head;
+} sieve_analytics;
+
+/** Name of each pattern in the report */
+extern const char *const analytics_pattern_names[ANALYTICS_PATTERN_COUNT];
+
+void analytics_init(sieve_analytics *a);
+
+/**
+ * @brief Account for the next prime p, larger than every prime added before
+ */
+void analytics_add(sieve_analytics *a, uint64_t p);
+
+/**
+ * @brief Add the primes of the sieved wheel bytes [first_byte, first_byte + n_bytes), bits[0] being first_byte
+ */
+void analytics_scan(sieve_analytics *a, const uint8_t *bits, uint64_t first_byte, uint64_t n_bytes);
+
+/**
+ * @brief Append right, whose primes all follow those of left, to left
+ */
+void analytics_merge(sieve_analytics *left, const sieve_analytics *right);
+
+/**
+ * @brief Sieve [low, high] through one segment buffer per thread and gather the statistics in out
+ * @param bp every prime <= sqrt(high)
+ * @param n_threads 0 -> online cpus
+ * @return 0 on success, -1 if the memory could not be allocated
+ */
+int analytics_range(uint64_t low, uint64_t high, const base_primes *bp, uint64_t segment_bytes, int n_threads,
+                    sieve_analytics *out);
+
+/**
+ * @brief SIEVE_OUTPUT_ANALYTICS of the shared memory backends: res->analytics and res->count
+ * @return 0 on success, -1 if the memory could not be allocated
+ */
+int analytics_run(const sieve_config *cfg, sieve_result *res, int n_threads);
+
+#ifdef SIEVE_HAVE_MPI
+/**
+ * @brief SIEVE_OUTPUT_ANALYTICS of the MPI backends
+ *
+ * Every rank gathers the statistics of its block with n_threads threads, and
+ * the master merges the blocks in rank order.
+ */
+int analytics_run_mpi(const sieve_config *cfg, sieve_result *res, int n_threads);
+#endif
+
+/**
+ * @brief Write the statistics as JSON
+ */
+void analytics_print(FILE *out, const sieve_analytics *a);
+
+#endif
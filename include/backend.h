@@ -0,0 +1,96 @@
+#ifndef _BACKEND_H_
+#define _BACKEND_H_
+
+#include "sieve.h"
+#include "segment.h"
+
+/** The following defines have been taken from:
+    Parallel programming in C with MPI and OpenMP
+    Michael J. Quinn
+    Chapter: 5.4.3 Block Decomposition Macros
+    @param id rank of the process
+    @param p number of processes
+    @param n buffer dimension. Sieve up to n.
+*/
+#define BLOCK_LOW(id, p, n) ((id) * (n) / (p))
+#define BLOCK_HIGH(id, p, n) (BLOCK_LOW((id) + 1, p, n) - 1)
+#define BLOCK_SIZE(id, p, n) (BLOCK_HIGH(id, p, n) - BLOCK_LOW(id, p, n) + 1)
+#define BLOCK_OWNER(index, p, n) (((p) * ((index) + 1) - 1) / (n))
+
+/**
+ * @brief Interface implemented by every libsieve backend
+ *
+ * run() sieves [cfg->min, cfg->max], stores the number of primes and the
+ * elapsed time in res and leaves the packed wheel in res->bits (see wheel.h),
+ * starting at the byte cfg->min / 30. stream() writes the primes as they are
+ * sieved instead (SIEVE_OUTPUT_STREAM), NULL when the backend cannot stream.
+ * analyze() gathers res->analytics instead of the sieve (SIEVE_OUTPUT_ANALYTICS).
+ */
+typedef struct
+{
+    const char *name;
+    int (*run)(const sieve_config *cfg, sieve_result *res);
+    int (*stream)(const sieve_config *cfg, sieve_result *res);
+    int (*analyze)(const sieve_config *cfg, sieve_result *res);
+} sieve_backend_ops;
+
+/**
+ * @brief Whether the caller needs the packed sieve in res->bits or only the count
+ */
+bool backend_needs_bits(const sieve_config *cfg);
+
+/**
+ * @brief Threads of the paths that bypass the backends (cache, LMO): 1 for the sequential backend
+ * @return cfg->n_threads otherwise, 0 -> online cpus
+ */
+int backend_threads(const sieve_config *cfg);
+
+/**
+ * @brief Sieve [low, high] with a pool of work-stealing threads
+ *
+ * Shared by the pthread and hybrid MPI backends.
+ * @param bits destination of the wheel bytes (bits[0] is the byte low / 30), NULL to only
+ *             count them through one segment buffer per thread
+ * @param bp every prime <= sqrt(high)
+ * @param n_threads 0 -> online cpus
+ * @param numa pin the threads to the NUMA nodes and bind the initial range of each one to its node
+ * @param count set to the number of primes >= 7 in the range
+ * @return 0 on success, -1 on failure
+ */
+int pthread_sieve(uint8_t *bits, uint64_t low, uint64_t high, const base_primes *bp,
+                  uint64_t segment_bytes, int n_threads, bool numa, uint64_t *count);
+
+#ifdef SIEVE_HAVE_MPI
+/**
+ * @brief Sieve of the block of one rank, for mpi_collective_run()
+ * @param block destination of the wheel bytes (block[0] is the byte low / 30), NULL to only count them
+ * @param count set to the number of primes >= 7 in [low, high]
+ * @return 0 on success, -1 on failure
+ */
+typedef int (*mpi_block_sieve)(const sieve_config *cfg, uint8_t *block, uint64_t low, uint64_t high,
+                               const base_primes *bp, uint64_t *count);
+
+/**
+ * @brief run() of the collective MPI backends
+ *
+ * Splits the range in one block per rank, broadcasts the base primes, sums
+ * the counts with MPI_Reduce and gathers the blocks on the master only when
+ * the primes are needed. Shared by the collective and hybrid MPI backends.
+ * @param alloc allocates the block of the rank when it is gathered, released with sieve_free()
+ * @param sieve sieves the block of the rank
+ * @return 0 on success, -1 on failure
+ */
+int mpi_collective_run(const sieve_config *cfg, sieve_result *res, void *(*alloc)(uint64_t size),
+                       mpi_block_sieve sieve);
+#endif
+
+extern const sieve_backend_ops backend_sequential;
+extern const sieve_backend_ops backend_pthread;
+extern const sieve_backend_ops backend_openmp;
+#ifdef SIEVE_HAVE_MPI
+extern const sieve_backend_ops backend_mpi;
+extern const sieve_backend_ops backend_mpi_collective;
+extern const sieve_backend_ops backend_mpi_hybrid;
+#endif
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include "sieve.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Persistent prime cache: the packed sieve of [0, limit] in a file
+ *
+ * Layout, all integers little-endian as on x86:
+ *    cache_header, padded to CACHE_HEADER_BYTES
+ *    n_bytes wheel bytes (wheel.h), byte k holds 30k + {1, 7, ..., 29}
+ *    n_blocks + 1 uint64_t: primes below each block of CACHE_BLOCK_BYTES
+ * n_bytes is a multiple of CACHE_BLOCK_BYTES, so limit = 30 * n_bytes - 1.
+ *
+ * Readers map the file read-only: pi(x) is one index lookup plus the popcount
+ * of at most one block. A query past the limit extends the file by sieving
+ * only the missing bytes, which are appended before the index is rewritten.
+ * Readers hold a shared flock() and the extension an exclusive one.
+ */
+
+#define CACHE_MAGIC "PRIMEBIT"
+#define CACHE_VERSION 1
+/** The bitset starts on a page boundary */
+#define CACHE_HEADER_BYTES 4096
+/** Wheel bytes per index entry: a pi(x) query popcounts at most this much */
+#define CACHE_BLOCK_BYTES 4096
+/** Set while the file is being extended: a crash leaves it set and the cache is rebuilt */
+#define CACHE_DIRTY 1u
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t block_bytes;
+    uint64_t n_bytes; // wheel bytes in the file
+} cache_header;
+
+typedef struct
+{
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    uint64_t n_bytes;
+    const uint8_t *bits;    // wheel byte 0 is the byte of 0..29
+    const uint64_t *index;  // index[b]: primes in the blocks before b
+} prime_cache;
+
+/**
+ * @brief Map a cache file read-only
+ * @return 0 on success, -1 if the file does not exist or is not a valid cache
+ */
+int prime_cache_open(prime_cache *cache, const char *path);
+
+void prime_cache_close(prime_cache *cache);
+
+/**
+ * @brief Create the cache file or extend it so that it covers [0, max]
+ *
+ * An empty file, or a cache left incomplete or of another version, is rebuilt
+ * from scratch; a non-empty file without the cache magic is never modified.
+ * @param n_threads threads sieving the new bytes, 0 -> online cpus
+ * @return 0 on success, -1 on failure (not a cache, I/O error, out of memory or disk)
+ */
+int prime_cache_extend(const char *path, uint64_t max, int n_threads, uint64_t segment_bytes);
+
+/**
+ * @brief Largest number covered by the cache
+ */
+static inline uint64_t prime_cache_limit(const prime_cache *cache)
+{
+    return cache->n_bytes * 30 - 1;
+}
+
+/**
+ * @brief Number of primes <= x, x must not exceed prime_cache_limit()
+ */
+uint64_t prime_cache_pi(const prime_cache *cache, uint64_t x);
+
+/**
+ * @brief Number of primes in [low, high], high must not exceed prime_cache_limit()
+ */
+uint64_t prime_cache_count(const prime_cache *cache, uint64_t low, uint64_t high);
+
+/**
+ * @brief Answer [cfg->min, cfg->max] from cfg->cache_path, extending the cache first if needed
+ *
+ * Fills the count and, when the primes are needed, the packed bits of res.
+ * @return 0 on success, -1 on failure
+ */
+int cache_run(const sieve_config *cfg, sieve_result *res);
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef _LAZY_H_
+#define _LAZY_H_
+
+#include "segment.h"
+#include "wheel.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+/**
+ * @brief Sieve that grows on demand, shared by concurrent readers
+ *
+ * Nothing is sieved up front: a lookup past the sieved segments sieves the
+ * segment it needs, so memory and time follow the numbers actually asked
+ * about instead of a max fixed at startup. Any thread can extend the sieve,
+ * lookups or dedicated extender threads running lazy_sieve_extend() ahead.
+ *
+ * Segments are published in a two-level table of atomic pointers. A slot is
+ * NULL, claimed by the thread sieving it, or the finished segment, stored
+ * with release semantics: a reader loads it with acquire semantics and reads
+ * the bits without any lock. A finished segment never changes and is freed
+ * by lazy_sieve_free() only, so readers never wait behind an extension; only
+ * a lookup into a segment being sieved waits for that segment.
+ *
+ * The extenders share the base primes, replaced by a 4 times larger bound
+ * (16 times the range) when a segment goes past them. The older sets are
+ * kept until lazy_sieve_free(): an extender may still be sieving with one.
+ */
+
+/** Wheel bytes of a segment */
+#define LAZY_SEGMENT_BYTES SEGMENT_BYTES
+/** Numbers covered by a segment */
+#define LAZY_SEGMENT_SPAN ((uint64_t)LAZY_SEGMENT_BYTES * WHEEL_SPAN)
+/** Segments per block of the table: blocks are allocated when first reached */
+#define LAZY_BLOCK_SEGMENTS (1 << 14)
+/** Blocks of the table */
+#define LAZY_BLOCKS (1 << 18)
+/** Largest number of a lazy sieve: 2^32 segments, about 4.2 * 10^15 */
+#define LAZY_MAX ((uint64_t)LAZY_BLOCKS * LAZY_BLOCK_SEGMENTS * LAZY_SEGMENT_SPAN - 1)
+
+typedef struct
+{
+    uint64_t count;                     // primes of the segment
+    uint8_t bits[LAZY_SEGMENT_BYTES];   // packed wheel from the byte index * LAZY_SEGMENT_BYTES
+} lazy_segment;
+
+typedef _Atomic(lazy_segment *) lazy_slot;
+
+typedef struct lazy_base
+{
+    base_primes bp;          // every prime <= sqrt(high)
+    uint64_t high;           // last number the base primes can sieve
+    struct lazy_base *older; // previous set, freed with the sieve
+} lazy_base;
+
+typedef struct
+{
+    _Atomic(lazy_slot *) *blocks;  // LAZY_BLOCKS blocks of LAZY_BLOCK_SEGMENTS slots
+    _Atomic uint64_t ready;        // segments [0, ready) are all sieved
+    _Atomic uint64_t sieved;       // segments sieved so far
+    _Atomic(lazy_base *) base;     // newest base primes
+    pthread_mutex_t base_lock;     // serialises the extenders replacing base
+} lazy_sieve;
+
+/**
+ * @return 0 on success, -1 if the memory could not be allocated
+ */
+int lazy_sieve_init(lazy_sieve *s);
+
+/**
+ * @brief Release every segment: no thread may use the sieve any more
+ */
+void lazy_sieve_free(lazy_sieve *s);
+
+/**
+ * @brief Sieve every segment up to the one of high that is not sieved yet
+ *
+ * Threads extending the same range share its segments: each one sieves the
+ * free segments it claims, then waits for the ones claimed by the others. An
+ * extender keeps its crossing-off state from one claimed segment to the next
+ * and only repositions it past the segments claimed by other threads.
+ * @return 0 on success, -1 if high is past LAZY_MAX or the memory could not be allocated
+ */
+int lazy_sieve_extend(lazy_sieve *s, uint64_t high);
+
+/**
+ * @brief Every number up to the returned one is sieved, 0 if none is
+ */
+uint64_t lazy_sieve_limit(lazy_sieve *s);
+
+/**
+ * @brief Whether n is prime, sieving its segment if needed
+ * @return 1 if n is prime, 0 if not, -1 if n is past LAZY_MAX or the memory could not be allocated
+ */
+int lazy_sieve_is_prime(lazy_sieve *s, uint64_t n);
+
+/**
+ * @brief Smallest prime > n, sieving the segments on the way
+ * @return the prime, 0 if it is past LAZY_MAX or the memory could not be allocated
+ */
+uint64_t lazy_sieve_next_prime(lazy_sieve *s, uint64_t n);
+
+/**
+ * @brief Number of primes in [low, high], sieving the segments on the way
+ * @return 0 on success, -1 if high is past LAZY_MAX or the memory could not be allocated
+ */
+int lazy_sieve_count(lazy_sieve *s, uint64_t low, uint64_t high, uint64_t *count);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef _LMO_H_
+#define _LMO_H_
+
+#include "sieve.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/**
+ * @brief Lagarias-Miller-Odlyzko prime counting: pi(x) without sieving up to x
+ *
+ * With a = pi(y), y = alpha * x^(1/3) and z = x / y:
+ *    pi(x) = phi(x, a) + a - 1 - P2(x, a)
+ *    phi(x, a) = S1 + S2
+ * S1 sums the ordinary leaves mu(n) phi(x / n, c), n <= y, using the periodic
+ * phi(., c) of the first c primes. S2 sums the special leaves, found while
+ * sieving [1, z] in segments with block counters of what is left after each
+ * prime. P2 counts the numbers <= x with two prime factors > y and sieves
+ * [sqrt(x), z] with the wheel engine (segment.h). Both are split among threads.
+ * Time is about x^(2/3), instead of x for the sieve. Memory is about x^(1/3)
+ * for the leaves plus the pi(sqrt(x)) base primes that P2 walks through, 4
+ * bytes each: these dominate, about 200 MB at x = 10^18.
+ */
+
+/**
+ * @brief Number of primes <= x
+ * @param n_threads 0 -> online cpus
+ * @return 0 on success, -1 if the memory could not be allocated
+ */
+int lmo_pi(uint64_t x, int n_threads, uint64_t *pi);
+
+/**
+ * @brief lmo_pi() that gives up once *cancel is set, checked after every sieved segment
+ * @param cancel NULL -> never cancelled
+ * @return 0 on success, -1 if the memory could not be allocated or the count was cancelled
+ */
+int lmo_pi_cancellable(uint64_t x, int n_threads, const atomic_bool *cancel, uint64_t *pi);
+
+/**
+ * @brief Count the primes of [cfg->min, cfg->max] as pi(max) - pi(min - 1)
+ * @return 0 on success, -1 on failure
+ */
+int lmo_run(const sieve_config *cfg, sieve_result *res);
+
+#endif
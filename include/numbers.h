@@ -0,0 +1,30 @@
+#ifndef _NUMBERS_H_
+#define _NUMBERS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+
+/**
+ * @brief Input of the batch tools: unsigned decimal numbers separated by white space
+ *
+ * Anything else is an error rather than a separator: "-11" is not 11, and
+ * "1e3" or "0x1f" are not two numbers each.
+ */
+
+/**
+ * @brief Parse every number of f, in order
+ * @param numbers set to an array of *n numbers to free(), NULL on failure
+ * @return 0 on success, -1 if a word is not a decimal number of at most 64 bits or the memory could not be allocated
+ */
+int numbers_read(FILE *f, uint64_t **numbers, size_t *n);
+
+/**
+ * @brief Parse one number of the command line: decimal, or in scientific notation (1e9, 2.5e10)
+ *
+ * The value is computed exactly in integers, it is not rounded through a double.
+ * @return 0 on success, -1 if s is not a whole number of at most 64 bits
+ */
+int numbers_parse(const char *s, uint64_t *value);
+
+#endif
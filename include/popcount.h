@@ -0,0 +1,19 @@
+#ifndef _POPCOUNT_H_
+#define _POPCOUNT_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Number of bits set in bytes[0, n)
+ *
+ * The implementation is picked once at runtime from the CPU features:
+ * AVX-512 VPOPCNTDQ, AVX2 (nibble lookup), POPCNT or a portable fallback.
+ */
+uint64_t popcount_bytes(const uint8_t *bytes, uint64_t n);
+
+/**
+ * @brief Name of the implementation selected for this CPU
+ */
+const char *popcount_impl(void);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef _PRIMALITY_H_
+#define _PRIMALITY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Deterministic primality test of a 64 bit number
+ *
+ * Trial division by the primes < 64, then strong probable prime tests in
+ * Montgomery form to the smallest known set of bases that no composite of
+ * that size passes: {2, 3, 5, 7} below 3.2 * 10^9, ..., and the seven bases
+ * of Sinclair {2, 325, 9375, 28178, 450775, 9780504, 1795265022} up to 2^64.
+ */
+bool prime_test(uint64_t n);
+
+/** Numbers below this are looked up in a sieved window when their window is dense */
+#define PRIME_BATCH_SIEVE_LIMIT (UINT64_C(1) << 32)
+/** Numbers per window: one segment of SEGMENT_BYTES (segment.h) */
+#define PRIME_BATCH_WINDOW (UINT64_C(32 * 1024) * 30)
+/** Numbers of the batch in a window for it to be sieved rather than tested one by one */
+#define PRIME_BATCH_DENSE 8192
+/** Numbers handed to a thread at a time */
+#define PRIME_BATCH_CHUNK 16384
+/** Numbers tested in lockstep by a thread: their independent products overlap in the pipeline */
+#define PRIME_BATCH_LANES 4
+
+/**
+ * @brief results[i] = prime_test(numbers[i]) for a batch, in input order
+ *
+ * The numbers are bucketed by window of PRIME_BATCH_WINDOW below
+ * PRIME_BATCH_SIEVE_LIMIT: windows holding at least PRIME_BATCH_DENSE of them
+ * are sieved and answer those by lookup. The others go through trial division
+ * and the Miller-Rabin test of prime_test(), PRIME_BATCH_LANES at a time.
+ * @param n_threads 0 -> online cpus
+ * @return 0 on success, -1 if the memory could not be allocated
+ */
+int prime_test_batch(const uint64_t *numbers, size_t n, bool *results, int n_threads);
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/**
+ * @brief Per-phase timers and hardware counters, compiled in with -DSIEVE_PROFILE (make PROFILE=1)
+ *
+ * Every thread accumulates, for each phase, the calls, the seconds and the
+ * perf_event_open() counters (cycles, instructions, LLC misses, dTLB misses,
+ * branch misses) of the calling thread in user space.
+ * Phases nest exclusively: an inner phase pauses the outer one, so the phases
+ * of a thread never count the same cycle twice. Counters the kernel refuses
+ * (no PMU in a VM, perf_event_paranoid) are reported as null, the timers
+ * still work.
+ *
+ * Without SIEVE_PROFILE the macros expand to nothing.
+ */
+
+typedef enum
+{
+    PROFILE_BASE_PRIMES,   // base_primes_init()
+    PROFILE_CROSS_OFF,     // crossing off the multiples in sieve_segment()
+    PROFILE_COUNT,         // popcount of the sieved segments
+    PROFILE_COMMUNICATION, // MPI transfers and synchronisation
+    PROFILE_OUTPUT,        // printing or streaming the primes
+    PROFILE_PHASE_COUNT
+} profile_phase;
+
+/**
+ * @brief Whether the library was compiled with SIEVE_PROFILE
+ */
+bool profile_enabled(void);
+
+#ifdef SIEVE_PROFILE
+
+void profile_begin(profile_phase phase);
+
+void profile_end(profile_phase phase);
+
+/**
+ * @brief Write the per-thread and total figures of every phase as a JSON object
+ * @param rank MPI rank of the caller, 0 without MPI
+ */
+void profile_report(FILE *out, int rank);
+
+#define PROFILE_BEGIN(phase) profile_begin(phase)
+#define PROFILE_END(phase) profile_end(phase)
+#define PROFILE_REPORT(out, rank) profile_report(out, rank)
+
+#else
+
+#define PROFILE_BEGIN(phase) ((void)0)
+#define PROFILE_END(phase) ((void)0)
+#define PROFILE_REPORT(out, rank) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef _QUERY_H_
+#define _QUERY_H_
+
+#include "sieve.h"
+
+#include <stdint.h>
+
+/**
+ * @brief Prime queries: the n-th prime, the next and the previous prime of x
+ *
+ * n-th prime: x = R^-1(n), the inverse of Riemann's R(x) = sum mu(k) / k li(x^(1/k)),
+ * which is much closer to p_n than the plain li^-1(n). pi(x) comes from the
+ * prime cache when it covers x, from LMO (lmo.h) otherwise, and windows sized
+ * from the remaining count are sieved from x toward p_n.
+ *
+ * Next / previous prime: windows next to x are sieved with the primes below
+ * QUERY_PRESIEVE_LIMIT only and the survivors are confirmed with prime_test()
+ * (primality.h), so even near 2^64 no base prime table up to 2^32 is built.
+ */
+
+/** Primes used to sieve the next / previous prime windows */
+#define QUERY_PRESIEVE_LIMIT 65536
+/** Wheel bytes of a next / previous prime window: 1920 numbers, more than any prime gap below 2^64 */
+#define QUERY_NEAR_BYTES 64
+/** Largest wheel bytes of an n-th prime correction window */
+#define QUERY_WINDOW_BYTES (1 << 22)
+
+/**
+ * @brief The n-th prime, p_1 = 2
+ * @param n_threads threads of the LMO count, 0 -> online cpus
+ * @param cache_path prime cache (cache.h) used for pi(x) when it covers x, NULL -> none
+ * @param p set to the prime, or to 0 when it does not fit in 64 bits
+ * @return 0 on success, -1 if the memory could not be allocated
+ */
+int query_nth_prime(uint64_t n, int n_threads, const char *cache_path, uint64_t *p);
+
+/**
+ * @brief Smallest prime > x, 0 if there is none below 2^64
+ * @return 0 on success, -1 if the memory could not be allocated
+ */
+int query_next_prime(uint64_t x, uint64_t *p);
+
+/**
+ * @brief Largest prime < x, 0 if x <= 2
+ * @return 0 on success, -1 if the memory could not be allocated
+ */
+int query_prev_prime(uint64_t x, uint64_t *p);
+
+/**
+ * @brief Answer cfg->query about cfg->max into res->prime
+ * @return 0 on success, -1 on failure
+ */
+int query_run(const sieve_config *cfg, sieve_result *res);
+
+#endif
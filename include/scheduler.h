@@ -0,0 +1,61 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/**
+ * @brief Work-stealing scheduler of segment indices for a pool of threads
+ *
+ * The tasks [0, n_tasks) are first split in one contiguous range per worker.
+ * A worker pops the front of its own range, so consecutive segments keep the
+ * crossing-off state warm; once it runs dry it steals the back half of the
+ * busiest worker's range and continues from there.
+ */
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    uint64_t head; // next task of the owner
+    uint64_t tail; // end of the range (excluded), thieves take from here
+    char pad[64];  // keep the deques of two workers on different cache lines
+} task_deque;
+
+typedef struct
+{
+    task_deque *deques;
+    int n_workers;
+} segment_scheduler;
+
+/**
+ * @return 0 on success, -1 if the memory could not be allocated
+ */
+int scheduler_init(segment_scheduler *sched, int n_workers, uint64_t n_tasks);
+
+/**
+ * @brief Next task for worker id
+ * @param task set to the task to run
+ * @param contiguous set to true when task directly follows the previous task of this worker
+ * @return false when every task has been handed out
+ */
+bool scheduler_next(segment_scheduler *sched, int id, uint64_t *task, bool *contiguous);
+
+void scheduler_free(segment_scheduler *sched);
+
+/**
+ * @brief Worker of scheduler_run(): takes its tasks from scheduler_next(sched, id, ...)
+ * @return 0 on success, -1 on failure
+ */
+typedef int (*scheduler_fn)(segment_scheduler *sched, int id, void *arg);
+
+/**
+ * @brief Run fn for the workers [0, n_workers) on a scheduler of n_tasks tasks
+ *
+ * Worker 0 runs on the calling thread, the others on threads of their own.
+ * The tasks of a worker whose thread could not start are stolen by the others.
+ * @return 0 on success, -1 if a worker failed or the scheduler could not be allocated (then fn never ran)
+ */
+int scheduler_run(int n_workers, uint64_t n_tasks, scheduler_fn fn, void *arg);
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef _SEGMENT_H_
+#define _SEGMENT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Segmented Sieve of Eratosthenes engine shared by every backend.
+ *
+ * The range to sieve is processed in cache-sized segments of packed wheel
+ * bytes (see wheel.h). Each base prime crosses off its multiples coprime
+ * to 30 following the wheel pattern and remembers where it stopped, so the
+ * next segment resumes without any division.
+ * Segments start from a copy of a pattern generated at build time
+ * (tools/presieve_gen.c) where the multiples of 7 to 19 are already
+ * crossed off: only the larger base primes are sieved.
+ */
+
+/** Default segment length in bytes (30 numbers each): fits the L1 data cache of most x86 cores */
+#define SEGMENT_BYTES (32 * 1024)
+
+/** Base primes: every one of them is <= sqrt(2^64 - 1) and fits in 32 bits */
+typedef struct
+{
+    uint32_t *primes; // base primes in increasing order
+    size_t count;     // number of base primes
+} base_primes;
+
+/** Multiples of large base primes stored in each bucket block */
+#define SIEVE_BUCKET_ENTRIES 1024
+
+struct sieve_bucket;
+
+/**
+ * @brief Crossing-off state of the base primes while walking through segments
+ *
+ * The base primes whose step (p / 30 bytes) is shorter than a segment visit
+ * every segment and keep their next multiple in next[]. The larger ones hit a
+ * segment once at most: they wait in a bucket of the segment holding their
+ * next multiple (Oliveira e Silva's bucket sieve), so a segment only walks
+ * through the primes that actually cross something off in it.
+ */
+typedef struct
+{
+    const base_primes *bp;
+    size_t first;   // index of the first base prime left out of the presieve pattern
+    size_t large;   // index of the first base prime sieved through the buckets
+    size_t pending; // index of the first large prime whose square is not reached yet, not in any bucket
+    size_t count;   // index past the last base prime <= sqrt(high)
+    uint64_t high;  // last number to sieve
+    uint64_t *next; // per prime below large: byte of the next multiple to cross off
+    uint8_t *wi;    // per prime below large: wheel index of the next multiplier
+    uint64_t span;                    // bytes covered by a bucket: the segment size, longer when short segments would need too many buckets
+    uint64_t origin;                  // byte of the last seek, buckets cover [origin + k span, origin + (k + 1) span)
+    uint64_t bucket_mask;             // number of buckets - 1, the buckets are reused circularly
+    struct sieve_bucket **buckets;    // per bucket: list of blocks of multiples
+    struct sieve_bucket *free_blocks; // blocks of the pool not in any bucket
+    struct sieve_bucket *pool;        // every block, sized so that it never runs out
+    size_t n_blocks;                  // blocks in the pool
+    size_t used_blocks;               // blocks of the pool handed out since the last seek
+} sieve_state;
+
+/**
+ * @brief Integer square root, exact for every 64 bit value
+ */
+uint64_t isqrt(uint64_t n);
+
+/**
+ * @brief Collect every prime <= limit
+ * @param limit at most UINT32_MAX, i.e. sqrt of the largest 64 bit number
+ * @return 0 on success, -1 if limit is too large or the memory could not be allocated
+ */
+int base_primes_init(base_primes *bp, uint64_t limit);
+
+void base_primes_free(base_primes *bp);
+
+/**
+ * @brief Prepare the crossing-off state for numbers up to high
+ *
+ * bp must contain every prime <= sqrt(high). The state must be positioned with
+ * sieve_state_seek() before sieving.
+ * @param segment_bytes length of the segments passed to sieve_segment(), 0 selects SEGMENT_BYTES;
+ *        shorter or longer segments are still sieved correctly
+ * @return 0 on success, -1 if the memory could not be allocated
+ */
+int sieve_state_init(sieve_state *st, const base_primes *bp, uint64_t high, uint64_t segment_bytes);
+
+/**
+ * @brief Move every base prime to its first multiple >= low
+ */
+void sieve_state_seek(sieve_state *st, uint64_t low);
+
+/**
+ * @brief Sieve the wheel bytes [first_byte, first_byte + n_bytes) into segment
+ *
+ * Bytes must be visited in increasing order after sieve_state_seek(). Only the
+ * numbers in [low, high] are kept: every bit outside that range is cleared.
+ * @return number of primes left in the segment, counted while it is still in cache
+ */
+uint64_t sieve_segment(sieve_state *st, uint8_t *segment, uint64_t first_byte, uint64_t n_bytes, uint64_t low);
+
+void sieve_state_free(sieve_state *st);
+
+/**
+ * @brief Sieve the numbers in [low, high] into packed wheel bytes
+ *
+ * bits[0] is the byte holding low (i.e. the byte low / 30). The bits of the
+ * primes in [low, high] are set, every other bit is cleared; 2, 3 and 5 are not
+ * represented by the wheel. Ranges sieved concurrently must not share a byte,
+ * so split them at multiples of 30.
+ * @param segment_bytes bytes processed per segment, 0 selects SEGMENT_BYTES
+ * @param count set to the number of primes >= 7 in [low, high], may be NULL
+ * @return 0 on success, -1 if the memory could not be allocated
+ */
+int segmented_sieve(uint8_t *bits, uint64_t low, uint64_t high, const base_primes *bp, uint64_t segment_bytes,
+                    uint64_t *count);
+
+/**
+ * @brief Number of primes >= 7 in [low, high], sieved through a single segment buffer
+ *
+ * Same as segmented_sieve() when only the count is needed: memory stays at one segment.
+ * @return 0 on success, -1 if the memory could not be allocated
+ */
+int segmented_count(uint64_t low, uint64_t high, const base_primes *bp, uint64_t segment_bytes, uint64_t *count);
+
+#endif
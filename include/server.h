@@ -0,0 +1,141 @@
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Prime query server: a long running process answering batches over a Unix socket
+ *
+ * The server sieves the base primes once at startup and keeps the last
+ * SERVER_BLOCK_BYTES blocks it sieved in an LRU cache, so a query costs a
+ * lookup or the sieve of one block instead of a process start and a full
+ * sieve. One thread runs the epoll loop of the connections, a pool of workers
+ * answers the batches.
+ *
+ * Protocol, all integers little-endian as on x86:
+ *    request:  server_header (count = number of queries), count server_query
+ *    response: server_header (count = number of results), then per query in
+ *              the order of the request: server_result, n_values uint64_t
+ * A connection may send its next request before the previous response
+ * arrives; responses come back in request order. A malformed header closes
+ * the connection.
+ *
+ *    SERVER_IS_PRIME    lo          -> 1 value, 1 if lo is prime, 0 otherwise
+ *    SERVER_COUNT       lo, hi      -> 1 value, number of primes in [lo, hi], hi <= lmo_max unless sieved
+ *    SERVER_NEXT_PRIME  lo          -> 1 value, smallest prime > lo, 0 past the last 64 bit prime
+ *    SERVER_PRIMES      lo, hi      -> the primes in [lo, hi], hi - lo < SERVER_MAX_LIST
+ *
+ * is_prime and next_prime read the cached blocks and confirm with
+ * prime_test() (primality.h) elsewhere, for every 64 bit number. count reads
+ * ranges of up to SERVER_SIEVE_BLOCKS blocks through the cache, sieves longer
+ * ones below the limit of the base primes segment by segment unless LMO
+ * (lmo.h) is cheaper, and uses LMO beyond the limit. A count that needs LMO
+ * past the LMO limit answers SERVER_ERANGE: its base primes and run time grow
+ * with hi and would hold a worker for hours. primes needs hi below the limit
+ * of the base primes. A shutdown cancels the counts in progress: they answer
+ * SERVER_ECANCELED instead of holding the server until they are done.
+ */
+
+#define SERVER_MAGIC 0x59524550u // "PERY" in memory: prime query
+#define SERVER_SOCKET_DEFAULT "/tmp/sieve.sock"
+/** Wheel bytes per cached block: 983040 numbers, one segment */
+#define SERVER_BLOCK_BYTES (32 * 1024)
+/** Cached blocks by default, 16 MB */
+#define SERVER_CACHE_BLOCKS 512
+/** Longest count range read through the cache: longer ones are sieved apart or counted with LMO */
+#define SERVER_SIEVE_BLOCKS 64
+/** lmo_pi(x) takes about as long as sieving SERVER_LMO_COST * x^(2/3) numbers */
+#define SERVER_LMO_COST 2
+/** Default largest hi counted with LMO: about 15 s on one core, 1e16 would take minutes */
+#define SERVER_LMO_MAX 100000000000000ull
+/** Longest range of a primes query, at most 5.8 million primes */
+#define SERVER_MAX_LIST 100000000u
+/** Most queries in one request */
+#define SERVER_MAX_QUERIES 65536
+/** Default limit: base primes up to 10^8 */
+#define SERVER_LIMIT_DEFAULT 10000000000000000ull
+
+typedef enum
+{
+    SERVER_IS_PRIME = 1,
+    SERVER_COUNT = 2,
+    SERVER_NEXT_PRIME = 3,
+    SERVER_PRIMES = 4,
+} server_op;
+
+typedef enum
+{
+    SERVER_OK = 0,
+    SERVER_EINVAL = 1, // unknown operation or lo > hi
+    SERVER_ERANGE = 2, // primes range too long or past the limit, count past the LMO limit
+    SERVER_ENOMEM = 3,
+    SERVER_ECANCELED = 4, // the server is shutting down
+} server_status;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t count;
+} server_header;
+
+typedef struct
+{
+    uint32_t op; // server_op
+    uint32_t reserved;
+    uint64_t lo;
+    uint64_t hi; // COUNT and PRIMES only
+} server_query;
+
+typedef struct
+{
+    int32_t status; // server_status
+    uint32_t reserved;
+    uint64_t n_values; // 0 unless status is SERVER_OK
+} server_result;
+
+typedef struct
+{
+    const char *socket_path;
+    int n_threads;         // workers, 0 -> online cpus
+    uint64_t limit;        // base primes up to sqrt(limit): largest number sieved
+    uint64_t lmo_max;      // largest hi of a count answered with LMO
+    uint64_t cache_blocks; // blocks of SERVER_BLOCK_BYTES kept in memory
+} server_config;
+
+void server_config_init(server_config *cfg);
+
+/**
+ * @brief Serve on cfg->socket_path until SIGINT or SIGTERM
+ *
+ * An existing socket file at that path is replaced and removed on exit.
+ * @return 0 on a clean shutdown, -1 if the server could not start
+ */
+int server_run(const server_config *cfg);
+
+/**
+ * @brief Answer of one query, as read by server_call()
+ */
+typedef struct
+{
+    server_status status;
+    uint64_t n_values;
+    const uint64_t *values;
+} server_answer;
+
+/**
+ * @brief Connect to a server
+ * @return socket descriptor, -1 on failure
+ */
+int server_connect(const char *socket_path);
+
+/**
+ * @brief Send one batch and wait for its answers
+ *
+ * answers[i] is the answer of queries[i]; their values point into *storage,
+ * which the caller frees.
+ * @return 0 on success, -1 on a connection or protocol error
+ */
+int server_call(int fd, const server_query *queries, uint32_t n, server_answer *answers, uint64_t **storage);
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef _SIEVE_H_
+#define _SIEVE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief libsieve: Sieve of Eratosthenes with pluggable backends
+ *
+ * Example:
+ *    sieve_config cfg;
+ *    sieve_result res;
+ *    sieve_config_init(&cfg);
+ *    cfg.max = 1000000;
+ *    cfg.backend = SIEVE_BACKEND_PTHREAD;
+ *    if (sieve_run(&cfg, &res) == 0)
+ *        printf("%lu primes\n", res.count);
+ *    sieve_result_free(&res);
+ *
+ * Set cfg.min to sieve the window [min, max] only: memory and time depend on
+ * max - min and sqrt(max), not on max itself, up to max = 2^64 - 1.
+ *
+ * With SIEVE_OUTPUT_STREAM the primes are written segment by segment as they
+ * are sieved, so memory does not grow with max. Streaming is supported by the
+ * shared memory backends (sequential, pthread, openmp).
+ *
+ * With cfg.cache_path set, the count and the primes come from a memory mapped
+ * file holding the sieve of [0, limit]: the file is created or extended when
+ * max goes past its limit, and repeated queries are answered without sieving.
+ * The MPI backends do not use the cache.
+ *
+ * cfg.method = SIEVE_METHOD_LMO counts the primes in about max^(2/3) time and
+ * max^(1/3) memory: pi(10^15) takes seconds where the sieve takes hours. It
+ * only gives the count and runs on threads, not on the MPI backends.
+ *
+ * cfg.query asks for one prime instead of a range: the max-th prime, or the
+ * prime after / before max (query.h). The answer is res.prime; the range is
+ * not sieved, only pi() of an estimate and small windows around the answer.
+ *
+ * The segment size, thread count and OpenMP chunks left at 0 come from the
+ * tuning profile of the machine when there is one (tune.h, sieve_bench --autotune).
+ *
+ * SIEVE_OUTPUT_ANALYTICS counts the twin primes, the prime k-tuples and the
+ * gaps in the same pass as the sieve, on every backend (analytics.h).
+ *
+ * The MPI backends are only available when linking libsieve_mpi, built with
+ * mpicc; the caller is in charge of MPI_Init() and MPI_Finalize(). The hybrid
+ * backend needs at least MPI_THREAD_FUNNELED from MPI_Init_thread().
+ */
+
+typedef enum
+{
+    SIEVE_BACKEND_SEQUENTIAL,
+    SIEVE_BACKEND_PTHREAD,
+    SIEVE_BACKEND_OPENMP,
+    SIEVE_BACKEND_MPI,            // Send/Recv of every block to the master
+    SIEVE_BACKEND_MPI_COLLECTIVE, // Bcast of the base primes and Reduce of the blocks
+    SIEVE_BACKEND_MPI_HYBRID,     // one rank per node, a pool of threads per rank
+    SIEVE_BACKEND_COUNT
+} sieve_backend;
+
+typedef enum
+{
+    SIEVE_OUTPUT_AUTO,   // list the primes when max - min <= 100, count them otherwise
+    SIEVE_OUTPUT_COUNT,  // number of primes only
+    SIEVE_OUTPUT_LIST,   // every prime
+    SIEVE_OUTPUT_STREAM, // every prime, written to output_path in the given format while sieving
+    SIEVE_OUTPUT_ANALYTICS, // twin primes, k-tuples and gaps gathered while sieving (analytics.h)
+    SIEVE_OUTPUT_NONE
+} sieve_output;
+
+/** How the primes are counted */
+typedef enum
+{
+    SIEVE_METHOD_SIEVE, // sieve the range with the selected backend
+    SIEVE_METHOD_LMO,   // count only, with the Lagarias-Miller-Odlyzko algorithm (lmo.h)
+    SIEVE_METHOD_COUNT
+} sieve_method;
+
+/** Single prime asked about cfg->max instead of the primes of the range */
+typedef enum
+{
+    SIEVE_QUERY_NONE,
+    SIEVE_QUERY_NTH,  // the max-th prime
+    SIEVE_QUERY_NEXT, // smallest prime > max
+    SIEVE_QUERY_PREV, // largest prime < max
+    SIEVE_QUERY_COUNT
+} sieve_query;
+
+/** Encoding of the streamed primes */
+typedef enum
+{
+    SIEVE_FORMAT_TEXT,  // one decimal number per line
+    SIEVE_FORMAT_U64,   // raw little-endian uint64_t
+    SIEVE_FORMAT_DELTA, // LEB128 varint of the difference with the previous prime (the first one from 0)
+    SIEVE_FORMAT_COUNT
+} sieve_format;
+
+typedef struct
+{
+    uint64_t min;            // sieve from min (included)
+    uint64_t max;            // sieve up to max (included)
+    sieve_backend backend;
+    sieve_output output;
+    int n_threads;           // 0 -> runtime default (online cpus / OMP_NUM_THREADS)
+    uint64_t segment_bytes;  // 0 -> SEGMENT_BYTES (segment.h)
+    int chunks_per_thread;   // chunks of segments handed out per OpenMP thread, 0 -> 32
+    bool keep_bits;          // keep the packed sieve in the result for sieve_count_range()
+    sieve_format format;     // encoding of SIEVE_OUTPUT_STREAM
+    const char *output_path; // destination of SIEVE_OUTPUT_STREAM, NULL or "-" -> stdout
+    const char *cache_path;  // prime cache file (cache.h) answering the count and list outputs, NULL -> none
+    sieve_method method;     // SIEVE_METHOD_LMO computes the count without sieving the range
+    sieve_query query;       // answer a query about max instead of sieving [min, max]
+    bool numa;               // pin the threads to the NUMA nodes and bind their part of the array there (alloc.h)
+} sieve_config;
+
+typedef struct
+{
+    uint64_t min;
+    uint64_t max;
+    uint64_t count;  // primes in [min, max]
+    double elapsed;  // seconds spent sieving
+    uint8_t *bits;   // packed wheel (wheel.h) from the byte min / 30, NULL unless the primes are listed or keep_bits is set
+    int rank;        // MPI rank of the caller: only rank 0 holds count and bits
+    uint64_t prime;  // answer of cfg->query, 0 if there is no such prime in 64 bits
+    struct sieve_analytics *analytics; // statistics of SIEVE_OUTPUT_ANALYTICS, NULL otherwise
+} sieve_result;
+
+/**
+ * @brief Fill cfg with the defaults: sequential backend, automatic output
+ */
+void sieve_config_init(sieve_config *cfg);
+
+/**
+ * @brief Sieve [cfg->min, cfg->max] with the selected backend
+ * @return 0 on success, -1 on failure (backend not available, min > max, out of memory)
+ */
+int sieve_run(const sieve_config *cfg, sieve_result *res);
+
+void sieve_result_free(sieve_result *res);
+
+/**
+ * @brief Number of primes in [low, high] (clamped to [res->min, res->max])
+ *
+ * Needs the packed sieve: run with keep_bits set or with a listing output.
+ * Counts 64 bit words with the fastest popcount of the CPU (popcount.h).
+ * @return the count, 0 when the sieve was not kept
+ */
+uint64_t sieve_count_range(const sieve_result *res, uint64_t low, uint64_t high);
+
+/**
+ * @brief Print the primes, their count or their statistics (JSON) as selected by cfg->output
+ *
+ * For a query, print its answer instead.
+ * Nothing is printed for SIEVE_OUTPUT_STREAM: sieve_run() already wrote the primes.
+ */
+void sieve_print_primes(const sieve_config *cfg, const sieve_result *res);
+
+const char *sieve_backend_name(sieve_backend backend);
+
+/**
+ * @return 0 and set *backend if name matches a backend, -1 otherwise
+ */
+int sieve_backend_from_name(const char *name, sieve_backend *backend);
+
+/**
+ * @brief Whether the backend has been compiled in this library
+ */
+bool sieve_backend_available(sieve_backend backend);
+
+const char *sieve_format_name(sieve_format format);
+
+/**
+ * @return 0 and set *format if name matches a format, -1 otherwise
+ */
+int sieve_format_from_name(const char *name, sieve_format *format);
+
+/**
+ * @brief Parse the command line shared by every front end
+ *
+ * Positional arguments are MAX and, if positional_threads is set, the number
+ * of threads. MAX may be given with --to instead. The options are listed by
+ * sieve_usage_options().
+ * @return 0 on success, -1 if the arguments are missing or invalid
+ */
+int sieve_parse_args(int argc, char *argv[], sieve_config *cfg, bool positional_threads);
+
+void sieve_usage_options(void);
+
+#endif
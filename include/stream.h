@@ -0,0 +1,42 @@
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include "sieve.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Streaming output of the primes with bounded memory
+ *
+ * The range is cut in tasks of a few contiguous segments. A pool of threads
+ * sieves the tasks and encodes their primes into per-task buffers, while the
+ * calling thread writes the finished buffers in order with writev(). Only a
+ * fixed ring of task buffers is alive at any time, so memory does not depend
+ * on the size of the range.
+ */
+
+/** Segments sieved and encoded by a thread before its buffer is handed to the writer */
+#define STREAM_SEGMENTS_PER_TASK 8
+/** Task buffers per thread: the writer drains one while the threads fill the other */
+#define STREAM_SLOTS_PER_THREAD 2
+/** Longest encoding of a prime: 20 decimal digits and a newline */
+#define STREAM_MAX_ENCODED 21
+
+/**
+ * @brief Append the encoding of p to out
+ * @param prev previous prime written, for SIEVE_FORMAT_DELTA
+ * @return pointer past the last byte written
+ */
+uint8_t *stream_encode(sieve_format format, uint8_t *out, uint64_t p, uint64_t prev);
+
+/**
+ * @brief Sieve [cfg->min, cfg->max] and write every prime to cfg->output_path in cfg->format
+ *
+ * Shared by the shared memory backends, fills the count and the elapsed time of res.
+ * @param n_threads sieving threads, 0 -> online cpus
+ * @return 0 on success, -1 on failure (output not writable, out of memory)
+ */
+int stream_primes(const sieve_config *cfg, sieve_result *res, int n_threads);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef _TUNE_H_
+#define _TUNE_H_
+
+#include "sieve.h"
+
+#include <stdio.h>
+#include <stddef.h>
+
+/**
+ * @brief Per-machine autotuning of the segment size, thread count and OpenMP chunking
+ *
+ * tune_calibrate() reads the cache sizes and the cores from sysfs, derives the
+ * candidates from them and times short counting runs of each one: segment
+ * size first (pthread backend, every cpu), then thread count, then the chunks
+ * handed out per OpenMP thread. tune_save() writes the winner to a file of
+ * this machine, and sieve_run() applies it on every later run to the
+ * parameters the configuration leaves at 0.
+ *
+ * The file is $SIEVE_TUNE_FILE, else $XDG_CACHE_HOME/libsieve/HOST.tune, else
+ * ~/.cache/libsieve/HOST.tune. It records the host, cpu model and cpu count
+ * and is ignored on another machine. An empty SIEVE_TUNE_FILE disables it.
+ */
+
+typedef struct
+{
+    uint64_t l1d_bytes; // per core
+    uint64_t l2_bytes;  // per core
+    uint64_t l3_bytes;  // shared, 0 when there is none
+    int cpus;           // online logical cpus
+    int cores;          // physical cores
+} tune_topology;
+
+typedef struct
+{
+    uint64_t segment_bytes;
+    int n_threads;
+    int chunks_per_thread;
+} tune_profile;
+
+/**
+ * @brief Cache sizes and cores of the host, defaults for what sysfs does not tell
+ */
+void tune_topology_read(tune_topology *topo);
+
+/**
+ * @brief Time the candidates and keep the fastest ones, a few seconds in total
+ * @param log progress of the sweep, NULL for none
+ * @return 0 on success, -1 if a run failed
+ */
+int tune_calibrate(tune_profile *profile, FILE *log);
+
+/**
+ * @brief Path of the profile of this machine
+ * @return 0 on success, -1 if profiles are disabled or there is no home directory
+ */
+int tune_path(char *path, size_t size);
+
+/**
+ * @return 0 on success, -1 if the file could not be written
+ */
+int tune_save(const tune_profile *profile);
+
+/**
+ * @return 0 on success, -1 without a profile for this machine
+ */
+int tune_load(tune_profile *profile);
+
+/**
+ * @brief Fill the segment size, threads and chunks left at 0 in cfg from the saved profile
+ *
+ * The profile is read once per process, on the first call that needs it: a
+ * profile saved afterwards applies from the next process on.
+ */
+void tune_apply(sieve_config *cfg);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef _WHEEL_H_
+#define _WHEEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Packed mod 30 wheel storage for the sieve array
+ *
+ * Only the 8 residues coprime to 30 can be prime (besides 2, 3 and 5), so
+ * byte k holds the numbers 30k + {1, 7, 11, 13, 17, 19, 23, 29}, one bit each.
+ * A bit set to 1 means the number is prime (unmarked), 0 means marked.
+ * This is 8 bits per 30 numbers instead of the 30 bytes of a char array.
+ */
+
+#define WHEEL_SPAN 30 // numbers covered by one byte
+
+/** Residue of each bit of a byte */
+extern const uint8_t wheel_residues[8];
+/** Distance from each residue to the next one (29 -> 31) */
+extern const uint8_t wheel_deltas[8];
+/** Bit mask of each residue mod 30, 0 when the residue is not coprime to 30 */
+extern const uint8_t wheel_bit[WHEEL_SPAN];
+/** Bit index of each residue mod 30, 0xff when the residue is not coprime to 30 */
+extern const uint8_t wheel_index[WHEEL_SPAN];
+
+typedef struct
+{
+    uint8_t mask;  // bit of the current multiple
+    uint8_t carry; // byte increment on top of (p / 30) * delta
+} wheel_step;
+
+/**
+ * @brief Crossing-off pattern of the multiples p * m, m coprime to 30
+ *
+ * Indexed by [wheel_index[p % 30]][wheel_index[m % 30]].
+ */
+extern const wheel_step wheel_steps[8][8];
+
+/**
+ * @brief Number of bytes needed to represent [low, high]
+ *
+ * The range starts at byte low / 30: bytes below it are never allocated.
+ */
+static inline uint64_t wheel_size(uint64_t low, uint64_t high)
+{
+    return high / WHEEL_SPAN - low / WHEEL_SPAN + 1;
+}
+
+/**
+ * @brief Whether n is prime; bits[0] must be the byte first_byte, the one of 30 * first_byte
+ */
+static inline bool wheel_is_prime(const uint8_t *bits, uint64_t first_byte, uint64_t n)
+{
+    if (n < 7)
+        return n == 2 || n == 3 || n == 5;
+    return (bits[n / WHEEL_SPAN - first_byte] & wheel_bit[n % WHEEL_SPAN]) != 0;
+}
+
+/**
+ * @brief Smallest prime > k and <= max, 0 if there is none
+ *
+ * bits[0] is the byte first_byte and k must not be below it.
+ */
+uint64_t wheel_next_prime(const uint8_t *bits, uint64_t first_byte, uint64_t max, uint64_t k);
+
+/**
+ * @brief Number of primes among 2, 3 and 5 (not stored in the wheel) in [low, high]
+ */
+static inline uint64_t wheel_small_primes(uint64_t low, uint64_t high)
+{
+    return (low <= 2 && 2 <= high) + (low <= 3 && 3 <= high) + (low <= 5 && 5 <= high);
+}
+
+/**
+ * @brief Number of primes in [low, high]; bits[0] must be the byte first_byte <= low / 30
+ */
+uint64_t wheel_count(const uint8_t *bits, uint64_t first_byte, uint64_t low, uint64_t high);
+
+#endif
@@ -0,0 +1,179 @@
+#define _GNU_SOURCE // sched_setaffinity()
+#include "alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#define HUGE_PAGE_BYTES (UINT64_C(2) << 20)
+/** Below one huge page the arrays come from malloc() */
+#define ALLOC_MAP_MIN HUGE_PAGE_BYTES
+#define NODE_PATH "/sys/devices/system/node"
+
+/**
+ * Mapping handed out by sieve_alloc(), looked up by sieve_free()
+ */
+typedef struct mapping
+{
+    void *addr;
+    uint64_t length;
+    struct mapping *next;
+} mapping;
+
+static pthread_mutex_t mappings_lock = PTHREAD_MUTEX_INITIALIZER;
+static mapping *mappings = NULL;
+
+/**
+ * Anonymous mapping of length bytes starting on a huge page boundary, for the transparent huge pages
+ */
+static void *map_aligned(uint64_t length)
+{
+    uint8_t *addr = (uint8_t *)mmap(NULL, length + HUGE_PAGE_BYTES, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+        return NULL;
+    uint64_t head = (HUGE_PAGE_BYTES - (uintptr_t)addr % HUGE_PAGE_BYTES) % HUGE_PAGE_BYTES;
+    if (head > 0)
+        munmap(addr, head);
+    munmap(addr + head + length, HUGE_PAGE_BYTES - head);
+    return addr + head;
+}
+
+void *sieve_alloc(uint64_t size)
+{
+    if (size < ALLOC_MAP_MIN)
+        return malloc(size);
+    mapping *m = (mapping *)malloc(sizeof(mapping));
+    if (m == NULL)
+        return NULL;
+    m->length = (size + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+    // reserved huge pages first: mmap() fails when there are not enough of them
+    m->addr = mmap(NULL, m->length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (m->addr == MAP_FAILED)
+    {
+        m->addr = map_aligned(m->length);
+        if (m->addr == NULL)
+        {
+            free(m);
+            return NULL;
+        }
+        madvise(m->addr, m->length, MADV_HUGEPAGE);
+    }
+    pthread_mutex_lock(&mappings_lock);
+    m->next = mappings;
+    mappings = m;
+    pthread_mutex_unlock(&mappings_lock);
+    return m->addr;
+}
+
+void sieve_free(void *p)
+{
+    if (p == NULL)
+        return;
+    mapping *found = NULL;
+    pthread_mutex_lock(&mappings_lock);
+    for (mapping **m = &mappings; *m != NULL; m = &(*m)->next)
+    {
+        if ((*m)->addr == p)
+        {
+            found = *m;
+            *m = found->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mappings_lock);
+    if (found == NULL)
+    {
+        free(p);
+        return;
+    }
+    munmap(found->addr, found->length);
+    free(found);
+}
+
+/**
+ * Parse a sysfs list such as "0-3,8-11" into set (when not NULL), return its largest number or -1
+ */
+static int read_list(const char *path, cpu_set_t *set)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return -1;
+    int largest = -1;
+    int first, last;
+    while (fscanf(f, "%d", &first) == 1)
+    {
+        last = first;
+        int c = fgetc(f);
+        if (c == '-')
+        {
+            if (fscanf(f, "%d", &last) != 1)
+                break;
+            c = fgetc(f);
+        }
+        for (int n = first; n <= last && set != NULL; n++)
+        {
+            if (n < CPU_SETSIZE)
+                CPU_SET(n, set);
+        }
+        largest = last > largest ? last : largest;
+        if (c != ',')
+            break;
+    }
+    fclose(f);
+    return largest;
+}
+
+int alloc_node_count(void)
+{
+    int largest = read_list(NODE_PATH "/online", NULL);
+    return largest < 0 ? 1 : largest + 1;
+}
+
+int alloc_worker_node(int id, int n_workers)
+{
+    return (int)((int64_t)id * alloc_node_count() / n_workers);
+}
+
+_Static_assert(sizeof(((alloc_affinity *)0)->mask) == sizeof(cpu_set_t), "alloc_affinity must hold a cpu_set_t");
+
+int alloc_bind_thread(int node, alloc_affinity *saved)
+{
+    if (saved != NULL)
+        saved->saved = false;
+    char path[64];
+    snprintf(path, sizeof(path), NODE_PATH "/node%d/cpulist", node);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (read_list(path, &set) < 0)
+        return -1;
+    if (saved != NULL)
+        saved->saved = sched_getaffinity(0, sizeof(saved->mask), (cpu_set_t *)saved->mask) == 0;
+    return sched_setaffinity(0, sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+void alloc_restore_thread(const alloc_affinity *saved)
+{
+    if (saved->saved)
+        sched_setaffinity(0, sizeof(saved->mask), (const cpu_set_t *)saved->mask);
+}
+
+void alloc_place(void *p, uint64_t size, int node)
+{
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)p + page - 1) / page * page;
+    uintptr_t end = ((uintptr_t)p + size) / page * page;
+    unsigned long mask = 0;
+    // the kernel reads maxnode - 1 bits of the mask
+    unsigned long maxnode = sizeof(mask) * 8;
+    if (node < 0 || (unsigned long)node >= maxnode - 1 || end <= start)
+        return;
+    mask = 1ul << node;
+    // preferred rather than bound: a full node falls back to the others instead of failing
+    syscall(SYS_mbind, (void *)start, end - start, MPOL_PREFERRED, &mask, maxnode, 0);
+}
@@ -0,0 +1,408 @@
+#include "analytics.h"
+#include "backend.h"
+#include "scheduler.h"
+#include "wheel.h"
+#include "timer.h"
+#include "profile.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef SIEVE_HAVE_MPI
+#include <mpi.h>
+#endif
+
+#define MASTER_NODE 0
+/** Bits of sieve_analytics.recent */
+#define RECENT_MASK ((UINT32_C(1) << (ANALYTICS_WIDTH + 1)) - 1)
+/** Every constellation has a prime at most this far below its last one */
+#define PATTERN_MAX_STEP 6
+
+const char *const analytics_pattern_names[ANALYTICS_PATTERN_COUNT] = {
+    [ANALYTICS_TWIN] = "twin",
+    [ANALYTICS_COUSIN] = "cousin",
+    [ANALYTICS_SEXY] = "sexy",
+    [ANALYTICS_TRIPLET_A] = "triplet_0_2_6",
+    [ANALYTICS_TRIPLET_B] = "triplet_0_4_6",
+    [ANALYTICS_QUADRUPLET] = "quadruplet",
+    [ANALYTICS_QUINTUPLET_A] = "quintuplet_0_2_6_8_12",
+    [ANALYTICS_QUINTUPLET_B] = "quintuplet_0_4_6_10_12",
+    [ANALYTICS_SEXTUPLET] = "sextuplet",
+};
+
+/**
+ * Per pattern: bit w - o of each offset o, w being the last offset, so that
+ * the pattern ends at the newest prime when all its bits are set in recent
+ */
+static const uint32_t pattern_masks[ANALYTICS_PATTERN_COUNT] = {
+    [ANALYTICS_TWIN] = 1u << 2 | 1u << 0,
+    [ANALYTICS_COUSIN] = 1u << 4 | 1u << 0,
+    [ANALYTICS_SEXY] = 1u << 6 | 1u << 0,
+    [ANALYTICS_TRIPLET_A] = 1u << 6 | 1u << 4 | 1u << 0,
+    [ANALYTICS_TRIPLET_B] = 1u << 6 | 1u << 2 | 1u << 0,
+    [ANALYTICS_QUADRUPLET] = 1u << 8 | 1u << 6 | 1u << 2 | 1u << 0,
+    [ANALYTICS_QUINTUPLET_A] = 1u << 12 | 1u << 10 | 1u << 6 | 1u << 4 | 1u << 0,
+    [ANALYTICS_QUINTUPLET_B] = 1u << 12 | 1u << 8 | 1u << 6 | 1u << 2 | 1u << 0,
+    [ANALYTICS_SEXTUPLET] = 1u << 16 | 1u << 12 | 1u << 10 | 1u << 6 | 1u << 4 | 1u << 0,
+};
+
+void analytics_init(sieve_analytics *a)
+{
+    memset(a, 0, sizeof(*a));
+}
+
+/**
+ * Shift the next prime, gap after the previous one, into a recent mask
+ */
+static inline uint32_t recent_push(uint32_t recent, uint64_t gap)
+{
+    return gap > ANALYTICS_WIDTH ? 1 : ((recent << gap) | 1) & RECENT_MASK;
+}
+
+static inline void count_patterns(uint32_t recent, uint64_t *patterns)
+{
+    for (int k = 0; k < ANALYTICS_PATTERN_COUNT; k++)
+        patterns[k] += (recent & pattern_masks[k]) == pattern_masks[k];
+}
+
+static void add_gap_record(sieve_analytics *a, uint64_t prime, uint64_t gap)
+{
+    if (a->n_records < ANALYTICS_MAX_RECORDS)
+        a->records[a->n_records++] = (analytics_record){prime, gap};
+}
+
+static void add_gap(sieve_analytics *a, uint64_t prime, uint64_t gap)
+{
+    a->gaps[gap < ANALYTICS_MAX_GAP ? gap : ANALYTICS_MAX_GAP - 1]++;
+    if (a->n_records == 0 || gap > a->records[a->n_records - 1].gap)
+        add_gap_record(a, prime, gap);
+}
+
+void analytics_add(sieve_analytics *a, uint64_t p)
+{
+    if (a->count == 0)
+    {
+        a->first = p;
+        a->recent = 1;
+    }
+    else
+    {
+        uint64_t gap = p - a->last;
+        add_gap(a, a->last, gap);
+        a->recent = recent_push(a->recent, gap);
+        if (gap <= PATTERN_MAX_STEP)
+            count_patterns(a->recent, a->patterns);
+    }
+    if (p - a->first <= ANALYTICS_WIDTH && a->n_head < ANALYTICS_EDGE)
+        a->head[a->n_head++] = p;
+    a->last = p;
+    a->count++;
+}
+
+void analytics_scan(sieve_analytics *a, const uint8_t *bits, uint64_t first_byte, uint64_t n_bytes)
+{
+    // the running state stays in registers: the gaps histogram is the only store per prime
+    uint64_t first = a->first;
+    uint64_t last = a->last;
+    uint64_t count = a->count;
+    uint32_t recent = a->recent;
+    uint64_t record = a->n_records > 0 ? a->records[a->n_records - 1].gap : 0;
+    for (uint64_t i = 0; i < n_bytes; i++)
+    {
+        uint64_t base = (first_byte + i) * WHEEL_SPAN;
+        for (unsigned word = bits[i]; word != 0; word &= word - 1)
+        {
+            uint64_t p = base + wheel_residues[__builtin_ctz(word)];
+            if (count == 0 || p - first <= ANALYTICS_WIDTH)
+            {
+                // the first primes of the part also go to its head
+                a->last = last;
+                a->count = count;
+                a->recent = recent;
+                analytics_add(a, p);
+                first = a->first;
+                last = a->last;
+                count = a->count;
+                recent = a->recent;
+                record = a->n_records > 0 ? a->records[a->n_records - 1].gap : 0;
+                continue;
+            }
+            uint64_t gap = p - last;
+            a->gaps[gap < ANALYTICS_MAX_GAP ? gap : ANALYTICS_MAX_GAP - 1]++;
+            if (gap > record)
+            {
+                add_gap_record(a, last, gap);
+                record = gap;
+            }
+            recent = recent_push(recent, gap);
+            if (gap <= PATTERN_MAX_STEP)
+                count_patterns(recent, a->patterns);
+            last = p;
+            count++;
+        }
+    }
+    a->last = last;
+    a->count = count;
+    a->recent = recent;
+}
+
+/**
+ * Primes of a within ANALYTICS_WIDTH of its last one, increasing, read from the recent mask
+ */
+static int tail_primes(const sieve_analytics *a, uint64_t *tail)
+{
+    int n = 0;
+    for (int i = ANALYTICS_WIDTH; i >= 0; i--)
+    {
+        if ((a->recent >> i) & 1)
+            tail[n++] = a->last - i;
+    }
+    return n;
+}
+
+/**
+ * Add the constellations found in an increasing list of primes, with sign +1 or -1
+ */
+static void list_patterns(const uint64_t *primes, int n, uint64_t *patterns, int sign)
+{
+    uint64_t found[ANALYTICS_PATTERN_COUNT] = {0};
+    uint32_t recent = 0;
+    for (int i = 0; i < n; i++)
+    {
+        recent = recent_push(recent, i == 0 ? ANALYTICS_WIDTH + 1 : primes[i] - primes[i - 1]);
+        count_patterns(recent, found);
+    }
+    for (int k = 0; k < ANALYTICS_PATTERN_COUNT; k++)
+        patterns[k] += sign > 0 ? found[k] : 0 - found[k];
+}
+
+void analytics_merge(sieve_analytics *left, const sieve_analytics *right)
+{
+    if (right->count == 0)
+        return;
+    if (left->count == 0)
+    {
+        *left = *right;
+        return;
+    }
+    // constellations across the boundary: those of the joined edges minus those inside each edge
+    uint64_t edges[2 * ANALYTICS_EDGE + ANALYTICS_WIDTH];
+    int n_tail = tail_primes(left, edges);
+    memcpy(edges + n_tail, right->head, right->n_head * sizeof(uint64_t));
+    list_patterns(edges, n_tail + right->n_head, left->patterns, 1);
+    list_patterns(edges, n_tail, left->patterns, -1);
+    list_patterns(right->head, right->n_head, left->patterns, -1);
+    for (int k = 0; k < ANALYTICS_PATTERN_COUNT; k++)
+        left->patterns[k] += right->patterns[k];
+
+    add_gap(left, left->last, right->first - left->last);
+    for (int g = 0; g < ANALYTICS_MAX_GAP; g++)
+        left->gaps[g] += right->gaps[g];
+    // a record of right is still one when it beats every gap of left and the boundary
+    for (int r = 0; r < right->n_records; r++)
+    {
+        if (right->records[r].gap > left->records[left->n_records - 1].gap && left->n_records < ANALYTICS_MAX_RECORDS)
+            left->records[left->n_records++] = right->records[r];
+    }
+
+    for (int i = 0; i < right->n_head && left->n_head < ANALYTICS_EDGE; i++)
+    {
+        if (right->head[i] - left->first <= ANALYTICS_WIDTH)
+            left->head[left->n_head++] = right->head[i];
+    }
+    // primes of left still within the width of the new last prime
+    uint32_t recent = right->recent;
+    for (int i = 0; i < n_tail; i++)
+    {
+        if (right->last - edges[i] <= ANALYTICS_WIDTH)
+            recent |= UINT32_C(1) << (right->last - edges[i]);
+    }
+    left->recent = recent;
+    left->last = right->last;
+    left->count += right->count;
+}
+
+typedef struct
+{
+    uint64_t low;
+    uint64_t high;
+    uint64_t first;         // byte of low
+    uint64_t n_bytes;
+    uint64_t segment_bytes;
+    uint64_t n_segments;
+    uint64_t n_parts;
+    const base_primes *bp;
+    sieve_analytics *parts;
+} analytics_task;
+
+static int analyze_parts(segment_scheduler *sched, int id, void *arg)
+{
+    const analytics_task *w = (const analytics_task *)arg;
+    sieve_state st;
+    uint8_t *segment = (uint8_t *)malloc(w->segment_bytes);
+    if (segment == NULL || sieve_state_init(&st, w->bp, w->high, w->segment_bytes) != 0)
+    {
+        free(segment);
+        return -1;
+    }
+    uint64_t part;
+    bool contiguous;
+    bool positioned = false;
+    while (scheduler_next(sched, id, &part, &contiguous))
+    {
+        sieve_analytics *a = &w->parts[part];
+        uint64_t begin = BLOCK_LOW(part, w->n_parts, w->n_segments);
+        uint64_t end = BLOCK_LOW(part + 1, w->n_parts, w->n_segments);
+        if (!positioned || !contiguous)
+            sieve_state_seek(&st, (w->first + begin * w->segment_bytes) * WHEEL_SPAN);
+        positioned = true;
+        // 2, 3 and 5 are not in the wheel
+        for (uint64_t p = 2; part == 0 && p <= 5; p += (p == 2 ? 1 : 2))
+        {
+            if (w->low <= p && p <= w->high)
+                analytics_add(a, p);
+        }
+        for (uint64_t s = begin; s < end; s++)
+        {
+            uint64_t offset = s * w->segment_bytes;
+            uint64_t size = w->n_bytes - offset < w->segment_bytes ? w->n_bytes - offset : w->segment_bytes;
+            sieve_segment(&st, segment, w->first + offset, size, w->low);
+            PROFILE_BEGIN(PROFILE_COUNT);
+            analytics_scan(a, segment, w->first + offset, size);
+            PROFILE_END(PROFILE_COUNT);
+        }
+    }
+    sieve_state_free(&st);
+    free(segment);
+    return 0;
+}
+
+int analytics_range(uint64_t low, uint64_t high, const base_primes *bp, uint64_t segment_bytes, int n_threads,
+                    sieve_analytics *out)
+{
+    analytics_init(out);
+    if (low > high)
+        return 0;
+    if (n_threads <= 0)
+        n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    analytics_task shared = {.low = low, .high = high, .first = low / WHEEL_SPAN, .bp = bp};
+    shared.n_bytes = wheel_size(low, high);
+    shared.segment_bytes = segment_bytes > 0 ? segment_bytes : SEGMENT_BYTES;
+    shared.n_segments = (shared.n_bytes + shared.segment_bytes - 1) / shared.segment_bytes;
+    shared.n_parts = (uint64_t)n_threads * ANALYTICS_PARTS_PER_THREAD;
+    if (shared.n_parts > shared.n_segments)
+        shared.n_parts = shared.n_segments;
+    shared.parts = (sieve_analytics *)malloc(shared.n_parts * sizeof(sieve_analytics));
+    if (shared.parts == NULL)
+        return -1;
+    for (uint64_t p = 0; p < shared.n_parts; p++)
+        analytics_init(&shared.parts[p]);
+    int ret = scheduler_run(n_threads, shared.n_parts, analyze_parts, &shared);
+    for (uint64_t p = 0; ret == 0 && p < shared.n_parts; p++)
+        analytics_merge(out, &shared.parts[p]);
+    free(shared.parts);
+    return ret;
+}
+
+int analytics_run(const sieve_config *cfg, sieve_result *res, int n_threads)
+{
+    sieve_analytics *a = (sieve_analytics *)malloc(sizeof(sieve_analytics));
+    // the base primes are timed, as in the run() of every backend
+    double start, end;
+    GET_TIME(start);
+    base_primes bp;
+    if (a == NULL || base_primes_init(&bp, isqrt(cfg->max)) != 0)
+    {
+        free(a);
+        return -1;
+    }
+    int ret = analytics_range(cfg->min, cfg->max, &bp, cfg->segment_bytes, n_threads, a);
+    GET_TIME(end);
+    base_primes_free(&bp);
+    if (ret != 0)
+    {
+        free(a);
+        return -1;
+    }
+    res->elapsed = end - start;
+    res->count = a->count;
+    res->analytics = a;
+    return 0;
+}
+
+#ifdef SIEVE_HAVE_MPI
+int analytics_run_mpi(const sieve_config *cfg, sieve_result *res, int n_threads)
+{
+    int rank = 0, comm_size = 1;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+    res->rank = rank;
+
+    // same blocks as the backends, cut at byte boundaries so that no number is in two of them
+    uint64_t n = wheel_size(cfg->min, cfg->max);
+    uint64_t base = cfg->min / WHEEL_SPAN;
+    uint64_t start = base + BLOCK_LOW(rank, comm_size, n);
+    uint64_t end = base + BLOCK_HIGH(rank, comm_size, n);
+    uint64_t low = start == base ? cfg->min : start * WHEEL_SPAN;
+    uint64_t high = end >= cfg->max / WHEEL_SPAN ? cfg->max : end * WHEEL_SPAN + WHEEL_SPAN - 1;
+
+    sieve_analytics *local = (sieve_analytics *)malloc(sizeof(sieve_analytics));
+    sieve_analytics *all = NULL;
+    if (rank == MASTER_NODE)
+        all = (sieve_analytics *)malloc(comm_size * sizeof(sieve_analytics));
+    base_primes bp;
+    if (local == NULL || (rank == MASTER_NODE && all == NULL) || base_primes_init(&bp, isqrt(cfg->max)) != 0)
+    {
+        printf("[%d] Error allocating memory\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start_time = MPI_Wtime();
+    analytics_init(local);
+    if (BLOCK_SIZE(rank, comm_size, n) > 0 && analytics_range(low, high, &bp, cfg->segment_bytes, n_threads, local) != 0)
+    {
+        printf("[%d] Error allocating memory\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    // 2, 3 and 5 are only added by the part starting at byte 0, which is the master's
+    PROFILE_BEGIN(PROFILE_COMMUNICATION);
+    MPI_Gather(local, (int)sizeof(sieve_analytics), MPI_BYTE, all, (int)sizeof(sieve_analytics), MPI_BYTE,
+               MASTER_NODE, MPI_COMM_WORLD);
+    PROFILE_END(PROFILE_COMMUNICATION);
+    base_primes_free(&bp);
+    if (rank == MASTER_NODE)
+    {
+        analytics_init(local);
+        for (int r = 0; r < comm_size; r++)
+            analytics_merge(local, &all[r]);
+        res->count = local->count;
+        res->analytics = local;
+        local = NULL;
+    }
+    res->elapsed = MPI_Wtime() - start_time;
+    free(local);
+    free(all);
+    return 0;
+}
+#endif
+
+void analytics_print(FILE *out, const sieve_analytics *a)
+{
+    fprintf(out, "{\n  \"count\": %lu,\n  \"first\": %lu,\n  \"last\": %lu,\n  \"constellations\": {", a->count,
+            a->first, a->last);
+    for (int k = 0; k < ANALYTICS_PATTERN_COUNT; k++)
+        fprintf(out, "%s\"%s\": %lu", k == 0 ? "" : ", ", analytics_pattern_names[k], a->patterns[k]);
+    fprintf(out, "},\n  \"gap_histogram\": {");
+    bool first = true;
+    for (int g = 0; g < ANALYTICS_MAX_GAP; g++)
+    {
+        if (a->gaps[g] == 0)
+            continue;
+        fprintf(out, "%s\"%d\": %lu", first ? "" : ", ", g, a->gaps[g]);
+        first = false;
+    }
+    fprintf(out, "},\n  \"maximal_gaps\": [");
+    for (int r = 0; r < a->n_records; r++)
+        fprintf(out, "%s[%lu, %lu]", r == 0 ? "" : ", ", a->records[r].prime, a->records[r].gap);
+    fprintf(out, "]\n}\n");
+}
@@ -0,0 +1,288 @@
+#include "backend.h"
+#include "segment.h"
+#include "wheel.h"
+#include "popcount.h"
+#include "analytics.h"
+#include "profile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <mpi.h>
+
+#define COMM_TAG 42
+#define MASTER_NODE 0
+/** Segments sieved before a message is sent */
+#define SEGMENTS_PER_MESSAGE 32
+/** Messages a worker can have in flight while it sieves the next one */
+#define SEND_BUFFERS 4
+/**
+ * @brief MPI implementation of the Sieve of Eratosthens
+ *
+ * The workers stream their block to the master in messages of a few segments:
+ * each message is sent with MPI_Isend while the next one is sieved. The master
+ * posts every MPI_Irecv straight into the final array up front, sieves its own
+ * block and then completes the receptions in arrival order with MPI_Waitany.
+ * When only the count is needed, the workers just send their count.
+ */
+
+/**
+ * Sieve the block [start, start + blk_size) message by message, calling MPI_Isend on each one
+ * @param low first number of the block (in the byte start)
+ */
+static uint64_t stream_block(const base_primes *bp, uint64_t low, uint64_t max, uint64_t start, uint64_t blk_size,
+                             uint64_t segment_bytes, uint64_t message_bytes)
+{
+    uint64_t count = 0;
+    uint8_t *buffers[SEND_BUFFERS];
+    MPI_Request requests[SEND_BUFFERS];
+    for (int b = 0; b < SEND_BUFFERS; b++)
+    {
+        buffers[b] = (uint8_t *)malloc(message_bytes);
+        requests[b] = MPI_REQUEST_NULL;
+        if (buffers[b] == NULL)
+        {
+            printf("Error allocating memory\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    sieve_state st;
+    if (sieve_state_init(&st, bp, max, segment_bytes) != 0)
+    {
+        printf("Error allocating memory\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    sieve_state_seek(&st, low);
+    uint64_t n_messages = (blk_size + message_bytes - 1) / message_bytes;
+    for (uint64_t m = 0; m < n_messages; m++)
+    {
+        // reuse the first buffer whose send has completed
+        int b;
+        if (m < SEND_BUFFERS)
+        {
+            b = (int)m;
+        }
+        else
+        {
+            MPI_Status status;
+            PROFILE_BEGIN(PROFILE_COMMUNICATION);
+            MPI_Waitany(SEND_BUFFERS, requests, &b, &status);
+            PROFILE_END(PROFILE_COMMUNICATION);
+        }
+        uint64_t first = start + m * message_bytes;
+        uint64_t size = start + blk_size - first < message_bytes ? start + blk_size - first : message_bytes;
+        for (uint64_t s = 0; s < size; s += segment_bytes)
+        {
+            uint64_t n_bytes = size - s < segment_bytes ? size - s : segment_bytes;
+            count += sieve_segment(&st, buffers[b] + s, first + s, n_bytes, low);
+        }
+        PROFILE_BEGIN(PROFILE_COMMUNICATION);
+        MPI_Isend(buffers[b], (int)size, MPI_BYTE, MASTER_NODE, COMM_TAG, MPI_COMM_WORLD, &requests[b]);
+        PROFILE_END(PROFILE_COMMUNICATION);
+    }
+    PROFILE_BEGIN(PROFILE_COMMUNICATION);
+    MPI_Waitall(SEND_BUFFERS, requests, MPI_STATUSES_IGNORE);
+    PROFILE_END(PROFILE_COMMUNICATION);
+    sieve_state_free(&st);
+    for (int b = 0; b < SEND_BUFFERS; b++)
+        free(buffers[b]);
+    return count;
+}
+
+static int run(const sieve_config *cfg, sieve_result *res)
+{
+    double start_time, end_time;
+    uint64_t min = cfg->min;
+    uint64_t max = cfg->max;
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    int comm_size = 1;
+    MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+    res->rank = rank;
+    uint64_t sqrt_max = isqrt(max);
+    bool gather = backend_needs_bits(cfg);
+    uint64_t segment_bytes = cfg->segment_bytes > 0 ? cfg->segment_bytes : SEGMENT_BYTES;
+    uint64_t message_bytes = segment_bytes * SEGMENTS_PER_MESSAGE;
+    // MPI counts are int: a message holds whole segments up to INT_MAX bytes
+    if (message_bytes > INT_MAX)
+        message_bytes = segment_bytes <= INT_MAX ? INT_MAX / segment_bytes * segment_bytes : INT_MAX;
+
+    /* Create a list of natural numbers Min..Max packed in a mod 30 wheel
+        1 -> unmarked (prime)
+        0 -> marked
+    */
+    uint8_t *natural_numbers = NULL;
+    if (rank == MASTER_NODE && gather) // Allocate all the array to collect the results later
+    {
+        natural_numbers = (uint8_t *)malloc(wheel_size(min, max));
+        if (natural_numbers == NULL)
+        {
+            printf("[%d] Error allocating memory\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    // Wait everyone is ready
+    MPI_Barrier(MPI_COMM_WORLD);
+    /**
+     * Start Benchmark
+     */
+    start_time = MPI_Wtime();
+
+    /*
+        1) The master node collects the base primes <= sqrt(max) and sends them to every process.
+    */
+    base_primes bp;
+    if (rank == MASTER_NODE)
+    {
+        if (base_primes_init(&bp, sqrt_max) != 0)
+        {
+            printf("[%d] Error allocating memory\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        uint64_t count = bp.count;
+        PROFILE_BEGIN(PROFILE_COMMUNICATION);
+        for (int i = 1; i < comm_size; i++)
+        {
+            MPI_Send(&count, 1, MPI_UINT64_T, i, COMM_TAG, MPI_COMM_WORLD);
+            MPI_Send(bp.primes, count, MPI_UINT32_T, i, COMM_TAG, MPI_COMM_WORLD);
+        }
+        PROFILE_END(PROFILE_COMMUNICATION);
+    }
+    else
+    {
+        MPI_Status status;
+        uint64_t count;
+        PROFILE_BEGIN(PROFILE_COMMUNICATION);
+        MPI_Recv(&count, 1, MPI_UINT64_T, MASTER_NODE, COMM_TAG, MPI_COMM_WORLD, &status);
+        bp.count = count;
+        bp.primes = (uint32_t *)malloc((count + 1) * sizeof(uint32_t));
+        if (bp.primes == NULL)
+        {
+            printf("[%d] Error allocating memory\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        MPI_Recv(bp.primes, count, MPI_UINT32_T, MASTER_NODE, COMM_TAG, MPI_COMM_WORLD, &status);
+        PROFILE_END(PROFILE_COMMUNICATION);
+    }
+
+    /*
+        Calculation of the operating blocks for each process
+    */
+    uint64_t n = wheel_size(min, max); // Bytes of the packed array, from the byte of min
+    uint64_t base = min / WHEEL_SPAN;
+    uint64_t start = base + BLOCK_LOW(rank, comm_size, n);
+    uint64_t end = base + BLOCK_HIGH(rank, comm_size, n);
+    uint64_t blk_size = BLOCK_SIZE(rank, comm_size, n);
+    uint64_t low = start == base ? min : start * WHEEL_SPAN;
+    uint64_t high = end >= max / WHEEL_SPAN ? max : end * WHEEL_SPAN + WHEEL_SPAN - 1;
+
+    uint64_t global_count = 0;
+    if (rank != MASTER_NODE)
+    {
+        // Each process calculate its prime numbers and streams them to the master node
+        uint64_t count = 0;
+        if (gather)
+            stream_block(&bp, low, max, start, blk_size, segment_bytes, message_bytes);
+        else if (blk_size > 0 && segmented_count(low, high, &bp, segment_bytes, &count) != 0)
+        {
+            printf("[%d] Error allocating memory\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        PROFILE_BEGIN(PROFILE_COMMUNICATION);
+        if (!gather && MPI_Send(&count, 1, MPI_UINT64_T, MASTER_NODE, COMM_TAG, MPI_COMM_WORLD) != MPI_SUCCESS)
+        {
+            printf("[%d] failed to send to Master Node\n", rank);
+        }
+        PROFILE_END(PROFILE_COMMUNICATION);
+    }
+    else if (!gather) // Master node, count only
+    {
+        if (blk_size > 0 && segmented_count(low, high, &bp, segment_bytes, &global_count) != 0)
+        {
+            printf("[%d] Error allocating memory\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        global_count += wheel_small_primes(min, max);
+        PROFILE_BEGIN(PROFILE_COMMUNICATION);
+        for (int id = 1; id < comm_size; id++)
+        {
+            uint64_t count;
+            MPI_Recv(&count, 1, MPI_UINT64_T, MPI_ANY_SOURCE, COMM_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            global_count += count;
+        }
+        PROFILE_END(PROFILE_COMMUNICATION);
+    }
+    else // Master node
+    {
+        // Post the receptions of every message directly into the final array
+        int n_requests = 0;
+        for (int id = 1; id < comm_size; id++)
+            n_requests += (int)((BLOCK_SIZE(id, comm_size, n) + message_bytes - 1) / message_bytes);
+        MPI_Request *requests = (MPI_Request *)malloc((n_requests + 1) * sizeof(MPI_Request));
+        uint64_t *offsets = (uint64_t *)malloc((n_requests + 1) * sizeof(uint64_t));
+        if (requests == NULL || offsets == NULL)
+        {
+            printf("[%d] Error allocating memory\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        int r = 0;
+        PROFILE_BEGIN(PROFILE_COMMUNICATION);
+        for (int id = 1; id < comm_size; id++)
+        {
+            uint64_t id_start = BLOCK_LOW(id, comm_size, n);
+            uint64_t id_size = BLOCK_SIZE(id, comm_size, n);
+            // messages from one process are matched in the order they were sent
+            for (uint64_t m = 0; m < id_size; m += message_bytes, r++)
+            {
+                int dim = (int)(id_size - m < message_bytes ? id_size - m : message_bytes);
+                offsets[r] = id_start + m;
+                MPI_Irecv(natural_numbers + offsets[r], dim, MPI_BYTE, id, COMM_TAG, MPI_COMM_WORLD, &requests[r]);
+            }
+        }
+        PROFILE_END(PROFILE_COMMUNICATION);
+        // Master process calculates its prima numbers
+        if (blk_size > 0 &&
+            segmented_sieve(natural_numbers + (start - base), low, high, &bp, segment_bytes, &global_count) != 0)
+        {
+            printf("[%d] Error allocating memory\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        global_count += wheel_small_primes(min, max);
+        // Complete the receptions as they arrive and count them while the others are in flight
+        for (int done = 0; done < n_requests; done++)
+        {
+            int index;
+            MPI_Status status;
+            PROFILE_BEGIN(PROFILE_COMMUNICATION);
+            MPI_Waitany(n_requests, requests, &index, &status);
+            PROFILE_END(PROFILE_COMMUNICATION);
+            int dim;
+            MPI_Get_count(&status, MPI_BYTE, &dim);
+            PROFILE_BEGIN(PROFILE_COUNT);
+            global_count += popcount_bytes(natural_numbers + offsets[index], dim);
+            PROFILE_END(PROFILE_COUNT);
+        }
+        free(requests);
+        free(offsets);
+    }
+    PROFILE_BEGIN(PROFILE_COMMUNICATION);
+    MPI_Barrier(MPI_COMM_WORLD);
+    PROFILE_END(PROFILE_COMMUNICATION);
+    end_time = MPI_Wtime();
+    base_primes_free(&bp);
+
+    res->elapsed = end_time - start_time;
+    if (rank == MASTER_NODE)
+    {
+        res->bits = natural_numbers;
+        res->count = global_count;
+    }
+    return 0;
+}
+
+static int analyze(const sieve_config *cfg, sieve_result *res)
+{
+    return analytics_run_mpi(cfg, res, 1);
+}
+
+const sieve_backend_ops backend_mpi = {"mpi", run, NULL, analyze};
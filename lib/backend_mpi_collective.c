@@ -0,0 +1,194 @@
+#include "backend.h"
+#include "segment.h"
+#include "wheel.h"
+#include "analytics.h"
+#include "profile.h"
+#include "alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <mpi.h>
+
+#define MASTER_NODE 0
+/**
+ * @brief MPI implementation of the Sieve of Eratosthens
+ *
+ * Every rank only holds the base primes and its own block of the packed
+ * array: the counts are summed with MPI_Reduce, and the blocks are gathered
+ * on the master only when the caller needs the primes themselves.
+ * Build with -DNOBCAST to let every process compute the base primes on its own.
+ */
+
+int mpi_collective_run(const sieve_config *cfg, sieve_result *res, void *(*alloc)(uint64_t size),
+                       mpi_block_sieve sieve)
+{
+    double start_time, end_time;
+    uint64_t min = cfg->min;
+    uint64_t max = cfg->max;
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    int comm_size = 1;
+    MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+    res->rank = rank;
+    uint64_t sqrt_max = isqrt(max);
+    bool gather = backend_needs_bits(cfg);
+
+    /**
+     * Calculation of the operating blocks for each process
+     */
+    uint64_t n = wheel_size(min, max); // Bytes of the packed array, from the byte of min
+    uint64_t base = min / WHEEL_SPAN;
+    uint64_t start = base + BLOCK_LOW(rank, comm_size, n);
+    uint64_t end = base + BLOCK_HIGH(rank, comm_size, n);
+    uint64_t blk_size = BLOCK_SIZE(rank, comm_size, n);
+    uint64_t low = start == base ? min : start * WHEEL_SPAN;
+    uint64_t high = end >= max / WHEEL_SPAN ? max : end * WHEEL_SPAN + WHEEL_SPAN - 1;
+    if (gather && n > INT_MAX) // MPI_Gatherv counts and displacements are int
+    {
+        if (rank == MASTER_NODE)
+            printf("[%d] The packed array is too large to be gathered, use the count output\n", rank);
+        return -1;
+    }
+
+    /** Create this rank's block of natural numbers packed in a mod 30 wheel
+     *   1 -> unmarked (prime)
+     *   0 -> marked
+     * The block is only needed when it has to be gathered, the count is sieved segment by segment.
+     */
+    uint8_t *block = NULL;
+    if (gather)
+    {
+        block = (uint8_t *)alloc(blk_size + 1);
+        if (block == NULL)
+        {
+            printf("[%d] Error allocating memory\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    // Wait that everyone is ready to do the computation
+    MPI_Barrier(MPI_COMM_WORLD);
+    /**
+     * Start Benchmark
+     */
+    start_time = MPI_Wtime();
+    /**
+     * The master process calculate prime numbers of the sqrt of MAX and broadcast to the results to the others processes
+     */
+    base_primes bp;
+#ifndef NOBCAST
+    uint64_t count = 0;
+    if (rank == MASTER_NODE)
+    {
+        if (base_primes_init(&bp, sqrt_max) != 0)
+        {
+            printf("[%d] Error allocating memory\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        count = bp.count;
+    }
+    PROFILE_BEGIN(PROFILE_COMMUNICATION);
+    MPI_Bcast(&count, 1, MPI_UINT64_T, MASTER_NODE, MPI_COMM_WORLD);
+    PROFILE_END(PROFILE_COMMUNICATION);
+    if (rank != MASTER_NODE)
+    {
+        bp.count = count;
+        bp.primes = (uint32_t *)malloc((count + 1) * sizeof(uint32_t));
+        if (bp.primes == NULL)
+        {
+            printf("[%d] Error allocating memory\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    PROFILE_BEGIN(PROFILE_COMMUNICATION);
+    MPI_Bcast(bp.primes, count, MPI_UINT32_T, MASTER_NODE, MPI_COMM_WORLD); // All the other nodes will have the same base primes
+    PROFILE_END(PROFILE_COMMUNICATION);
+#else // Every process calculates prime numbers on his own
+    if (base_primes_init(&bp, sqrt_max) != 0)
+    {
+        printf("[%d] Error allocating memory\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+#endif
+
+    uint64_t local_count = 0;
+    if (blk_size > 0 && sieve(cfg, block, low, high, &bp, &local_count) != 0)
+    {
+        printf("[%d] Error sieving the block\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (rank == MASTER_NODE)
+        local_count += wheel_small_primes(min, max);
+    uint64_t global_count = 0;
+    PROFILE_BEGIN(PROFILE_COMMUNICATION);
+    MPI_Reduce(&local_count, &global_count, 1, MPI_UINT64_T, MPI_SUM, MASTER_NODE, MPI_COMM_WORLD);
+    PROFILE_END(PROFILE_COMMUNICATION);
+
+    uint8_t *natural_numbers = NULL;
+    if (gather)
+    {
+        int *counts = NULL, *displs = NULL;
+        if (rank == MASTER_NODE)
+        {
+            natural_numbers = (uint8_t *)malloc(n);
+            counts = (int *)malloc(comm_size * sizeof(int));
+            displs = (int *)malloc(comm_size * sizeof(int));
+            if (natural_numbers == NULL || counts == NULL || displs == NULL)
+            {
+                printf("[%d] Error allocating memory\n", rank);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            for (int id = 0; id < comm_size; id++)
+            {
+                counts[id] = (int)BLOCK_SIZE(id, comm_size, n);
+                displs[id] = (int)BLOCK_LOW(id, comm_size, n);
+            }
+        }
+        PROFILE_BEGIN(PROFILE_COMMUNICATION);
+        MPI_Gatherv(block, (int)blk_size, MPI_BYTE, natural_numbers, counts, displs, MPI_BYTE, MASTER_NODE, MPI_COMM_WORLD);
+        PROFILE_END(PROFILE_COMMUNICATION);
+        free(counts);
+        free(displs);
+        sieve_free(block);
+    }
+    PROFILE_BEGIN(PROFILE_COMMUNICATION);
+    MPI_Barrier(MPI_COMM_WORLD);
+    PROFILE_END(PROFILE_COMMUNICATION);
+    end_time = MPI_Wtime();
+    base_primes_free(&bp);
+
+    res->elapsed = end_time - start_time;
+    if (rank == MASTER_NODE)
+    {
+        res->bits = natural_numbers;
+        res->count = global_count;
+    }
+    return 0;
+}
+
+static void *block_alloc(uint64_t size)
+{
+    return malloc(size);
+}
+
+/**
+ * One segment buffer for the count, the block itself when it is gathered
+ */
+static int block_sieve(const sieve_config *cfg, uint8_t *block, uint64_t low, uint64_t high, const base_primes *bp,
+                       uint64_t *count)
+{
+    return block != NULL ? segmented_sieve(block, low, high, bp, cfg->segment_bytes, count)
+                         : segmented_count(low, high, bp, cfg->segment_bytes, count);
+}
+
+static int run(const sieve_config *cfg, sieve_result *res)
+{
+    return mpi_collective_run(cfg, res, block_alloc, block_sieve);
+}
+
+static int analyze(const sieve_config *cfg, sieve_result *res)
+{
+    return analytics_run_mpi(cfg, res, 1);
+}
+
+const sieve_backend_ops backend_mpi_collective = {"mpi_collective", run, NULL, analyze};
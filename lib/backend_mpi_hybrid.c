@@ -0,0 +1,50 @@
+#include "backend.h"
+#include "alloc.h"
+#include "analytics.h"
+
+#include <stdio.h>
+#include <mpi.h>
+
+#define MASTER_NODE 0
+/**
+ * @brief Hybrid MPI + pthread implementation of the Sieve of Eratosthens
+ *
+ * Meant to run with one rank per node (or per NUMA domain): a single copy
+ * of the base primes per rank, and each rank sieves its block with the
+ * work-stealing thread pool of the pthread backend. Only the master thread
+ * calls MPI, so MPI_THREAD_FUNNELED is enough. The decomposition and the
+ * collectives are those of the collective backend (mpi_collective_run()).
+ */
+
+/**
+ * The thread pool of this rank sieves its block
+ */
+static int block_sieve(const sieve_config *cfg, uint8_t *block, uint64_t low, uint64_t high, const base_primes *bp,
+                       uint64_t *count)
+{
+    return pthread_sieve(block, low, high, bp, cfg->segment_bytes, cfg->n_threads, cfg->numa, count);
+}
+
+static int run(const sieve_config *cfg, sieve_result *res)
+{
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    res->rank = rank;
+    int provided;
+    MPI_Query_thread(&provided);
+    if (provided < MPI_THREAD_FUNNELED)
+    {
+        if (rank == MASTER_NODE)
+            printf("[%d] MPI must be initialized with MPI_Init_thread(MPI_THREAD_FUNNELED)\n", rank);
+        return -1;
+    }
+    // the threads of this rank initialize the block
+    return mpi_collective_run(cfg, res, sieve_alloc, block_sieve);
+}
+
+static int analyze(const sieve_config *cfg, sieve_result *res)
+{
+    return analytics_run_mpi(cfg, res, cfg->n_threads);
+}
+
+const sieve_backend_ops backend_mpi_hybrid = {"mpi_hybrid", run, NULL, analyze};
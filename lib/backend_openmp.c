@@ -0,0 +1,124 @@
+#include "backend.h"
+#include "segment.h"
+#include "alloc.h"
+#include "wheel.h"
+#include "stream.h"
+#include "analytics.h"
+#include "timer.h"
+
+#include <stdlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ * @brief OpenMP implementation of the Sieve of Erathostens
+ *
+ * One parallel region for the whole run: the threads pick cache-resident
+ * segments with a dynamic schedule and sieve each of them with every base
+ * prime before moving on.
+ */
+
+/** Default chunks handed out per thread: small enough to balance, large enough to keep the base primes positioned */
+#define CHUNKS_PER_THREAD 32
+
+static int run(const sieve_config *cfg, sieve_result *res)
+{
+    uint64_t min = cfg->min;
+    uint64_t max = cfg->max;
+    uint64_t segment_bytes = cfg->segment_bytes > 0 ? cfg->segment_bytes : SEGMENT_BYTES;
+    uint64_t n_bytes = wheel_size(min, max);
+    uint64_t first_byte = min / WHEEL_SPAN;
+    uint64_t n_tasks = (n_bytes + segment_bytes - 1) / segment_bytes;
+    // Create a list of natural numbers Min..Max packed in a mod 30 wheel, only when the primes are needed
+    uint8_t *natural_numbers = NULL;
+    if (backend_needs_bits(cfg))
+    {
+        natural_numbers = (uint8_t *)sieve_alloc(n_bytes); // the threads initialize every byte
+        if (natural_numbers == NULL)
+            return -1;
+    }
+
+    // BENCHMARK
+    double start, end;
+    GET_TIME(start);
+    base_primes bp;
+    if (base_primes_init(&bp, isqrt(max)) != 0)
+    {
+        sieve_free(natural_numbers);
+        return -1;
+    }
+    uint64_t count = wheel_small_primes(min, max);
+    int failed = 0;
+#ifdef _OPENMP
+    int n_threads = cfg->n_threads > 0 ? cfg->n_threads : omp_get_max_threads();
+#else
+    int n_threads = 1;
+#endif
+    int chunks_per_thread = cfg->chunks_per_thread > 0 ? cfg->chunks_per_thread : CHUNKS_PER_THREAD;
+    uint64_t chunk = n_tasks / ((uint64_t)n_threads * chunks_per_thread);
+    if (chunk == 0)
+        chunk = 1;
+    bool numa = cfg->numa && alloc_node_count() > 1;
+    #pragma omp parallel default(none) shared(natural_numbers, bp, min, max, first_byte, segment_bytes, n_bytes, n_tasks, chunk, numa) num_threads(n_threads) reduction(+:count, failed)
+    {
+        alloc_affinity affinity = {.saved = false};
+#ifdef _OPENMP
+        // pinned threads keep the pages they touch first on their own node
+        if (numa)
+            alloc_bind_thread(alloc_worker_node(omp_get_thread_num(), omp_get_num_threads()), &affinity);
+#endif
+        // without the array every segment of the thread is sieved into one buffer
+        uint8_t *scratch = natural_numbers == NULL ? (uint8_t *)malloc(segment_bytes) : NULL;
+        sieve_state st;
+        failed = (natural_numbers == NULL && scratch == NULL) || sieve_state_init(&st, &bp, max, segment_bytes) != 0;
+        uint64_t next_task = UINT64_MAX;
+        #pragma omp for schedule(dynamic, chunk)
+        for (uint64_t task = 0; task < n_tasks; task++)
+        {
+            if (failed)
+                continue;
+            uint64_t offset = task * segment_bytes;
+            uint64_t size = n_bytes - offset < segment_bytes ? n_bytes - offset : segment_bytes;
+            // the base primes only need to be moved at the start of a chunk
+            if (task != next_task)
+                sieve_state_seek(&st, (first_byte + offset) * WHEEL_SPAN);
+            uint8_t *segment = scratch != NULL ? scratch : natural_numbers + offset;
+            count += sieve_segment(&st, segment, first_byte + offset, size, min);
+            next_task = task + 1;
+        }
+        if (!failed)
+            sieve_state_free(&st);
+        free(scratch);
+        // the pool outlives the run: later parallel regions of the caller must not stay pinned
+        alloc_restore_thread(&affinity);
+    }
+    GET_TIME(end);
+    base_primes_free(&bp);
+
+    res->elapsed = end - start;
+    res->bits = natural_numbers;
+    res->count = count;
+    return failed ? -1 : 0;
+}
+
+static int stream(const sieve_config *cfg, sieve_result *res)
+{
+    // the streaming pipeline has its own thread pool, sized like the OpenMP team
+#ifdef _OPENMP
+    return stream_primes(cfg, res, cfg->n_threads > 0 ? cfg->n_threads : omp_get_max_threads());
+#else
+    return stream_primes(cfg, res, 1);
+#endif
+}
+
+static int analyze(const sieve_config *cfg, sieve_result *res)
+{
+#ifdef _OPENMP
+    return analytics_run(cfg, res, cfg->n_threads > 0 ? cfg->n_threads : omp_get_max_threads());
+#else
+    return analytics_run(cfg, res, 1);
+#endif
+}
+
+const sieve_backend_ops backend_openmp = {"openmp", run, stream, analyze};
@@ -0,0 +1,148 @@
+#include "backend.h"
+#include "segment.h"
+#include "scheduler.h"
+#include "alloc.h"
+#include "wheel.h"
+#include "stream.h"
+#include "analytics.h"
+#include "timer.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * @brief Pthread implementation of the Sieve of Eratosthens
+ *
+ * The packed array is cut in cache-sized segments handed out by a
+ * work-stealing scheduler, so that a slow core does not set the wall time.
+ */
+
+typedef struct
+{
+    uint8_t *n_numbers;           // pointer to natural numbers buffer (byte first), NULL to count only
+    const base_primes *bp;        // primes <= sqrt(high), shared by every thread
+    uint64_t low;                 // first number of the range
+    uint64_t high;                // last number of the range
+    uint64_t first;               // first byte of the range, low / 30
+    uint64_t size;                // bytes of the range
+    uint64_t segment_bytes;
+    uint64_t *counts;             // per worker: primes it found
+    int n_threads;
+    bool numa;                    // pin the threads to their node and bind their initial range there
+} th_data;
+
+static int mark_segments(segment_scheduler *sched, int id, void *parameters)
+{
+    const th_data *data = (const th_data *)parameters;
+    sieve_state st;
+    uint8_t *scratch = NULL;
+    if (data->n_numbers == NULL)
+        scratch = (uint8_t *)malloc(data->segment_bytes);
+    if ((data->n_numbers == NULL && scratch == NULL) ||
+        sieve_state_init(&st, data->bp, data->high, data->segment_bytes) != 0)
+    {
+        free(scratch);
+        return -1;
+    }
+    // worker 0 is the calling thread: it gets its affinity back at the end
+    alloc_affinity affinity = {.saved = false};
+    if (data->numa)
+    {
+        // before the first touch: the scheduler starts each thread on the same block as scheduler_init()
+        int node = alloc_worker_node(id, data->n_threads);
+        alloc_bind_thread(node, &affinity);
+        if (data->n_numbers != NULL)
+        {
+            uint64_t n_tasks = (data->size + data->segment_bytes - 1) / data->segment_bytes;
+            uint64_t begin = BLOCK_LOW(id, data->n_threads, n_tasks) * data->segment_bytes;
+            uint64_t end = BLOCK_LOW(id + 1, data->n_threads, n_tasks) * data->segment_bytes;
+            alloc_place(data->n_numbers + begin, (end < data->size ? end : data->size) - begin, node);
+        }
+    }
+    uint64_t task;
+    bool contiguous;
+    bool positioned = false;
+    while (scheduler_next(sched, id, &task, &contiguous))
+    {
+        uint64_t offset = task * data->segment_bytes;
+        uint64_t size = data->size - offset < data->segment_bytes ? data->size - offset : data->segment_bytes;
+        // a stolen segment does not follow the previous one: move the base primes there
+        if (!positioned || !contiguous)
+            sieve_state_seek(&st, (data->first + offset) * WHEEL_SPAN);
+        positioned = true;
+        uint8_t *segment = scratch != NULL ? scratch : data->n_numbers + offset;
+        data->counts[id] += sieve_segment(&st, segment, data->first + offset, size, data->low);
+    }
+    alloc_restore_thread(&affinity);
+    sieve_state_free(&st);
+    free(scratch);
+    return 0;
+}
+
+int pthread_sieve(uint8_t *bits, uint64_t low, uint64_t high, const base_primes *bp,
+                  uint64_t segment_bytes, int n_threads, bool numa, uint64_t *count)
+{
+    *count = 0;
+    uint64_t size = wheel_size(low, high);
+    if (n_threads <= 0)
+        n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (segment_bytes == 0)
+        segment_bytes = SEGMENT_BYTES;
+    uint64_t n_tasks = (size + segment_bytes - 1) / segment_bytes;
+    uint64_t *counts = (uint64_t *)calloc(n_threads, sizeof(uint64_t));
+    if (counts == NULL)
+        return -1;
+    th_data data = {.n_numbers = bits, .bp = bp, .low = low, .high = high, .first = low / WHEEL_SPAN,
+                    .size = size, .segment_bytes = segment_bytes, .counts = counts, .n_threads = n_threads,
+                    .numa = numa && alloc_node_count() > 1};
+    int ret = scheduler_run(n_threads, n_tasks, mark_segments, &data);
+    for (int id = 0; id < n_threads; id++)
+        *count += counts[id];
+    free(counts);
+    return ret;
+}
+
+static int run(const sieve_config *cfg, sieve_result *res)
+{
+    uint64_t min = cfg->min;
+    uint64_t max = cfg->max;
+    // Create a list of natural numbers Min..Max packed in a mod 30 wheel, only when the primes are needed
+    uint8_t *natural_numbers = NULL;
+    if (backend_needs_bits(cfg))
+    {
+        natural_numbers = (uint8_t *)sieve_alloc(wheel_size(min, max)); // the threads initialize every byte
+        if (natural_numbers == NULL)
+            return -1;
+    }
+
+    // BENCHMARK
+    double start, end;
+    GET_TIME(start);
+    base_primes bp;
+    if (base_primes_init(&bp, isqrt(max)) != 0)
+    {
+        sieve_free(natural_numbers);
+        return -1;
+    }
+    uint64_t count;
+    int ret = pthread_sieve(natural_numbers, min, max, &bp, cfg->segment_bytes, cfg->n_threads, cfg->numa, &count);
+    GET_TIME(end);
+    base_primes_free(&bp);
+
+    res->elapsed = end - start;
+    res->bits = natural_numbers;
+    res->count = count + wheel_small_primes(min, max);
+    return ret;
+}
+
+static int stream(const sieve_config *cfg, sieve_result *res)
+{
+    return stream_primes(cfg, res, cfg->n_threads);
+}
+
+static int analyze(const sieve_config *cfg, sieve_result *res)
+{
+    return analytics_run(cfg, res, cfg->n_threads);
+}
+
+const sieve_backend_ops backend_pthread = {"pthread", run, stream, analyze};
@@ -0,0 +1,68 @@
+#include "backend.h"
+#include "segment.h"
+#include "alloc.h"
+#include "wheel.h"
+#include "stream.h"
+#include "analytics.h"
+#include "timer.h"
+
+#include <stdlib.h>
+
+/**
+ * @brief Sequential implementation of the Sieve of Erathostens
+ *
+ */
+
+static int run(const sieve_config *cfg, sieve_result *res)
+{
+    uint64_t min = cfg->min;
+    uint64_t max = cfg->max;
+    // Create a list of natural numbers Min..Max packed in a mod 30 wheel, only when the primes are needed
+    // 1 -> unmarked (prime)
+    // 0 -> marked
+    uint8_t *natural_numbers = NULL;
+    if (backend_needs_bits(cfg))
+    {
+        natural_numbers = (uint8_t *)sieve_alloc(wheel_size(min, max)); // the sieve initializes every byte
+        if (natural_numbers == NULL)
+            return -1;
+    }
+
+    // BENCHMARK
+    double start, end;
+    GET_TIME(start);
+    base_primes bp;
+    if (base_primes_init(&bp, isqrt(max)) != 0)
+    {
+        sieve_free(natural_numbers);
+        return -1;
+    }
+    uint64_t count;
+    // without the array the count is sieved through a single segment
+    int ret = natural_numbers != NULL ? segmented_sieve(natural_numbers, min, max, &bp, cfg->segment_bytes, &count)
+                                      : segmented_count(min, max, &bp, cfg->segment_bytes, &count);
+    GET_TIME(end);
+    base_primes_free(&bp);
+    if (ret != 0)
+    {
+        sieve_free(natural_numbers);
+        return -1;
+    }
+
+    res->elapsed = end - start;
+    res->bits = natural_numbers;
+    res->count = count + wheel_small_primes(min, max);
+    return 0;
+}
+
+static int stream(const sieve_config *cfg, sieve_result *res)
+{
+    return stream_primes(cfg, res, 1);
+}
+
+static int analyze(const sieve_config *cfg, sieve_result *res)
+{
+    return analytics_run(cfg, res, 1);
+}
+
+const sieve_backend_ops backend_sequential = {"sequential", run, stream, analyze};
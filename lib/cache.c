@@ -0,0 +1,228 @@
+#include "cache.h"
+#include "backend.h"
+#include "segment.h"
+#include "wheel.h"
+#include "popcount.h"
+#include "timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * File size of a cache of n_bytes wheel bytes
+ */
+static size_t cache_file_size(uint64_t n_bytes)
+{
+    return CACHE_HEADER_BYTES + n_bytes + (n_bytes / CACHE_BLOCK_BYTES + 1) * sizeof(uint64_t);
+}
+
+static bool header_valid(const cache_header *header, size_t file_size)
+{
+    return memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) == 0 &&
+           header->version == CACHE_VERSION && !(header->flags & CACHE_DIRTY) &&
+           header->block_bytes == CACHE_BLOCK_BYTES && header->n_bytes > 0 &&
+           header->n_bytes % CACHE_BLOCK_BYTES == 0 && file_size == cache_file_size(header->n_bytes);
+}
+
+int prime_cache_open(prime_cache *cache, const char *path)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->fd = open(path, O_RDONLY);
+    if (cache->fd < 0)
+        return -1;
+    struct stat st;
+    if (flock(cache->fd, LOCK_SH) != 0 || fstat(cache->fd, &st) != 0 || (size_t)st.st_size < CACHE_HEADER_BYTES)
+        goto fail;
+    cache->map_size = st.st_size;
+    cache->map = (uint8_t *)mmap(NULL, cache->map_size, PROT_READ, MAP_SHARED, cache->fd, 0);
+    if (cache->map == MAP_FAILED)
+    {
+        cache->map = NULL;
+        goto fail;
+    }
+    const cache_header *header = (const cache_header *)cache->map;
+    if (!header_valid(header, cache->map_size))
+        goto fail;
+    cache->n_bytes = header->n_bytes;
+    cache->bits = cache->map + CACHE_HEADER_BYTES;
+    cache->index = (const uint64_t *)(cache->bits + cache->n_bytes);
+    return 0;
+
+fail:
+    prime_cache_close(cache);
+    return -1;
+}
+
+void prime_cache_close(prime_cache *cache)
+{
+    if (cache->map != NULL)
+        munmap(cache->map, cache->map_size);
+    if (cache->fd >= 0)
+        close(cache->fd); // releases the lock
+    memset(cache, 0, sizeof(*cache));
+    cache->fd = -1;
+}
+
+int prime_cache_extend(const char *path, uint64_t max, int n_threads, uint64_t segment_bytes)
+{
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        perror(path);
+        return -1;
+    }
+    // other readers and writers wait until the file is consistent again
+    struct stat st;
+    if (flock(fd, LOCK_EX) != 0 || fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    cache_header header;
+    uint64_t old_bytes = 0;
+    bool ours = (size_t)st.st_size >= sizeof(header) && pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+                memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) == 0;
+    // a cache left dirty or of another version is rebuilt, any other file is left alone
+    if (st.st_size > 0 && !ours)
+    {
+        fprintf(stderr, "%s: not a prime cache, left untouched\n", path);
+        close(fd);
+        return -1;
+    }
+    if (ours && header_valid(&header, st.st_size))
+        old_bytes = header.n_bytes;
+    uint64_t new_bytes = (max / WHEEL_SPAN / CACHE_BLOCK_BYTES + 1) * CACHE_BLOCK_BYTES;
+    if (new_bytes <= old_bytes) // extended by someone else in the meantime
+    {
+        close(fd);
+        return 0;
+    }
+
+    // the old index is overwritten by the new bytes: keep it aside
+    uint64_t old_blocks = old_bytes / CACHE_BLOCK_BYTES;
+    uint64_t new_blocks = new_bytes / CACHE_BLOCK_BYTES;
+    uint64_t *index = (uint64_t *)malloc((new_blocks + 1) * sizeof(uint64_t));
+    if (index == NULL)
+    {
+        close(fd);
+        return -1;
+    }
+    size_t index_size = (old_blocks + 1) * sizeof(uint64_t);
+    if (old_bytes > 0 && pread(fd, index, index_size, CACHE_HEADER_BYTES + old_bytes) != (ssize_t)index_size)
+        old_bytes = old_blocks = 0;
+    if (old_bytes == 0)
+        index[0] = 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.flags = CACHE_DIRTY;
+    header.block_bytes = CACHE_BLOCK_BYTES;
+    header.n_bytes = old_bytes;
+    size_t map_size = cache_file_size(new_bytes);
+    uint8_t *map = MAP_FAILED;
+    if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header) || fdatasync(fd) != 0 ||
+        ftruncate(fd, map_size) != 0 ||
+        (map = (uint8_t *)mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        perror(path);
+        free(index);
+        close(fd);
+        return -1;
+    }
+
+    // Sieve the new bytes only, straight into the file
+    uint8_t *bits = map + CACHE_HEADER_BYTES;
+    uint64_t low = old_bytes * WHEEL_SPAN;
+    uint64_t high = new_bytes * WHEEL_SPAN - 1;
+    base_primes bp;
+    uint64_t count;
+    int ret = -1;
+    if (base_primes_init(&bp, isqrt(high)) == 0)
+    {
+        ret = pthread_sieve(bits + old_bytes, low, high, &bp, segment_bytes, n_threads, false, &count);
+        base_primes_free(&bp);
+    }
+    if (ret == 0)
+    {
+        // 2, 3 and 5 are not in the wheel, the first block accounts for them
+        for (uint64_t b = old_blocks; b < new_blocks; b++)
+            index[b + 1] = index[b] + popcount_bytes(bits + b * CACHE_BLOCK_BYTES, CACHE_BLOCK_BYTES) + (b == 0 ? 3 : 0);
+        memcpy(bits + new_bytes, index, (new_blocks + 1) * sizeof(uint64_t));
+        // the data must be on disk before the header says it is valid
+        if (msync(map, map_size, MS_SYNC) == 0)
+        {
+            header.flags = 0;
+            header.n_bytes = new_bytes;
+            memcpy(map, &header, sizeof(header));
+            ret = msync(map, CACHE_HEADER_BYTES, MS_SYNC);
+        }
+        else
+        {
+            ret = -1;
+        }
+    }
+    munmap(map, map_size);
+    free(index);
+    close(fd);
+    return ret;
+}
+
+uint64_t prime_cache_pi(const prime_cache *cache, uint64_t x)
+{
+    uint64_t block = x / WHEEL_SPAN / CACHE_BLOCK_BYTES;
+    // wheel_count() adds 2, 3 and 5 when x is in the first block, the index does after it
+    return cache->index[block] + wheel_count(cache->bits, 0, block * CACHE_BLOCK_BYTES * WHEEL_SPAN, x);
+}
+
+uint64_t prime_cache_count(const prime_cache *cache, uint64_t low, uint64_t high)
+{
+    if (low > high)
+        return 0;
+    return prime_cache_pi(cache, high) - (low > 0 ? prime_cache_pi(cache, low - 1) : 0);
+}
+
+int cache_run(const sieve_config *cfg, sieve_result *res)
+{
+    double start, end;
+    GET_TIME(start);
+    prime_cache cache;
+    if (prime_cache_open(&cache, cfg->cache_path) != 0 || prime_cache_limit(&cache) < cfg->max)
+    {
+        prime_cache_close(&cache);
+        if (prime_cache_extend(cfg->cache_path, cfg->max, backend_threads(cfg), cfg->segment_bytes) != 0 ||
+            prime_cache_open(&cache, cfg->cache_path) != 0)
+            return -1;
+    }
+    res->count = prime_cache_count(&cache, cfg->min, cfg->max);
+    if (backend_needs_bits(cfg))
+    {
+        // copy the bytes of the range and clear what is out of [min, max] as the sieve does
+        uint64_t first = cfg->min / WHEEL_SPAN;
+        uint64_t n_bytes = wheel_size(cfg->min, cfg->max);
+        res->bits = (uint8_t *)malloc(n_bytes);
+        if (res->bits == NULL)
+        {
+            prime_cache_close(&cache);
+            return -1;
+        }
+        memcpy(res->bits, cache.bits + first, n_bytes);
+        for (int b = 0; b < 8; b++)
+        {
+            if (wheel_residues[b] < cfg->min % WHEEL_SPAN)
+                res->bits[0] &= ~(1u << b);
+            if (wheel_residues[b] > cfg->max % WHEEL_SPAN)
+                res->bits[n_bytes - 1] &= ~(1u << b);
+        }
+    }
+    prime_cache_close(&cache);
+    GET_TIME(end);
+    res->elapsed = end - start;
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include "sieve.h"
+#include "numbers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <getopt.h>
+
+static const struct option long_options[] = {
+    {"backend", required_argument, NULL, 'b'},
+    {"threads", required_argument, NULL, 't'},
+    {"segment", required_argument, NULL, 's'},
+    {"from", required_argument, NULL, 'f'},
+    {"to", required_argument, NULL, 'T'},
+    {"count", optional_argument, NULL, 'c'},
+    {"list", no_argument, NULL, 'l'},
+    {"quiet", no_argument, NULL, 'q'},
+    {"stream", required_argument, NULL, 'S'},
+    {"output", required_argument, NULL, 'o'},
+    {"cache", required_argument, NULL, 'C'},
+    {"nth-prime", required_argument, NULL, 'n'},
+    {"next-prime", required_argument, NULL, 'N'},
+    {"prev-prime", required_argument, NULL, 'P'},
+    {"numa", no_argument, NULL, 'u'},
+    {"analytics", no_argument, NULL, 'A'},
+    {NULL, 0, NULL, 0}};
+
+void sieve_usage_options(void)
+{
+    printf("\tOptions:\n");
+    printf("\t\t--backend NAME: sequential, pthread, openmp, mpi, mpi_collective, mpi_hybrid\n");
+    printf("\t\t--threads N: number of threads\n");
+    printf("\t\t--segment BYTES: segment size in bytes (30 numbers each)\n");
+    printf("\t\t--from LO --to HI: sieve the window [LO, HI] only, HI replaces MAX (up to 2^64 - 1)\n");
+    printf("\t\t--count | --list | --quiet: print the prime count, every prime or nothing\n");
+    printf("\t\t--count=lmo: count with the Lagarias-Miller-Odlyzko algorithm instead of sieving\n");
+    printf("\t\t--stream FORMAT: write every prime while sieving, FORMAT is text, u64 or delta\n");
+    printf("\t\t--output FILE: destination of --stream, stdout by default\n");
+    printf("\t\t--cache FILE: answer from a persistent sieve file, extended when MAX goes past it\n");
+    printf("\t\t--nth-prime N | --next-prime X | --prev-prime X: find a single prime, replaces MAX\n");
+    printf("\t\t--numa: pin the threads to the NUMA nodes, each with its part of the sieve in local memory\n");
+    printf("\t\t--analytics: count twin primes, prime k-tuples and gaps while sieving, printed as JSON\n");
+}
+
+/**
+ * Parse a thread count: a number of numbers.h up to INT_MAX
+ * @return 0 on success, -1 otherwise
+ */
+static int parse_threads(const char *s, int *n_threads)
+{
+    uint64_t value;
+    if (numbers_parse(s, &value) != 0 || value > INT_MAX)
+        return -1;
+    *n_threads = (int)value;
+    return 0;
+}
+
+int sieve_parse_args(int argc, char *argv[], sieve_config *cfg, bool positional_threads)
+{
+    int opt;
+    bool has_max = false;
+    optind = 1;
+    while ((opt = getopt_long(argc, argv, "b:t:s:clqo:", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'b':
+            if (sieve_backend_from_name(optarg, &cfg->backend) != 0)
+                return -1;
+            break;
+        case 't':
+            if (parse_threads(optarg, &cfg->n_threads) != 0)
+                return -1;
+            break;
+        case 's':
+            if (numbers_parse(optarg, &cfg->segment_bytes) != 0)
+                return -1;
+            break;
+        case 'f':
+            if (numbers_parse(optarg, &cfg->min) != 0)
+                return -1;
+            break;
+        case 'T':
+            if (numbers_parse(optarg, &cfg->max) != 0)
+                return -1;
+            has_max = true;
+            break;
+        case 'c':
+            cfg->output = SIEVE_OUTPUT_COUNT;
+            if (optarg != NULL && strcmp(optarg, "lmo") == 0)
+                cfg->method = SIEVE_METHOD_LMO;
+            else if (optarg != NULL && strcmp(optarg, "sieve") != 0)
+                return -1;
+            break;
+        case 'l':
+            cfg->output = SIEVE_OUTPUT_LIST;
+            break;
+        case 'q':
+            cfg->output = SIEVE_OUTPUT_NONE;
+            break;
+        case 'S':
+            if (sieve_format_from_name(optarg, &cfg->format) != 0)
+                return -1;
+            cfg->output = SIEVE_OUTPUT_STREAM;
+            break;
+        case 'o':
+            cfg->output_path = optarg;
+            break;
+        case 'C':
+            cfg->cache_path = optarg;
+            break;
+        case 'u':
+            cfg->numa = true;
+            break;
+        case 'A':
+            cfg->output = SIEVE_OUTPUT_ANALYTICS;
+            break;
+        case 'n':
+        case 'N':
+        case 'P':
+            cfg->query = opt == 'n' ? SIEVE_QUERY_NTH : opt == 'N' ? SIEVE_QUERY_NEXT : SIEVE_QUERY_PREV;
+            if (numbers_parse(optarg, &cfg->max) != 0)
+                return -1;
+            has_max = true;
+            break;
+        default:
+            return -1;
+        }
+    }
+    // MAX comes first unless --to already set it
+    int positional = argc - optind;
+    if (!has_max && positional > 0)
+    {
+        if (numbers_parse(argv[optind++], &cfg->max) != 0)
+            return -1;
+        has_max = true;
+        positional--;
+    }
+    if (!has_max || positional > (positional_threads ? 1 : 0) || cfg->min > cfg->max)
+        return -1;
+    if (positional == 1 && parse_threads(argv[optind], &cfg->n_threads) != 0)
+        return -1;
+    return 0;
+}
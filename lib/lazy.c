@@ -0,0 +1,294 @@
+#include "lazy.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+/** Base primes of the first set: 16 segments */
+#define FIRST_BASE_HIGH (16 * LAZY_SEGMENT_SPAN)
+
+/** Slot value of a segment being sieved: never dereferenced */
+static uint64_t busy_marker;
+#define BUSY ((lazy_segment *)&busy_marker)
+
+int lazy_sieve_init(lazy_sieve *s)
+{
+    // the pages of the block table are only mapped as blocks are reached
+    s->blocks = (_Atomic(lazy_slot *) *)calloc(LAZY_BLOCKS, sizeof(*s->blocks));
+    if (s->blocks == NULL)
+        return -1;
+    atomic_init(&s->ready, 0);
+    atomic_init(&s->sieved, 0);
+    atomic_init(&s->base, NULL);
+    pthread_mutex_init(&s->base_lock, NULL);
+    return 0;
+}
+
+void lazy_sieve_free(lazy_sieve *s)
+{
+    for (uint64_t b = 0; s->blocks != NULL && b < LAZY_BLOCKS; b++)
+    {
+        lazy_slot *block = atomic_load_explicit(&s->blocks[b], memory_order_relaxed);
+        for (uint64_t i = 0; block != NULL && i < LAZY_BLOCK_SEGMENTS; i++)
+        {
+            lazy_segment *seg = atomic_load_explicit(&block[i], memory_order_relaxed);
+            if (seg != BUSY)
+                free(seg);
+        }
+        free(block);
+    }
+    free(s->blocks);
+    s->blocks = NULL;
+    for (lazy_base *base = atomic_load_explicit(&s->base, memory_order_relaxed); base != NULL;)
+    {
+        lazy_base *older = base->older;
+        base_primes_free(&base->bp);
+        free(base);
+        base = older;
+    }
+    atomic_store_explicit(&s->base, NULL, memory_order_relaxed);
+    pthread_mutex_destroy(&s->base_lock);
+}
+
+/**
+ * Slot of a segment, its block allocated when create is set
+ * @return NULL if the block is missing or could not be allocated
+ */
+static lazy_slot *slot_of(lazy_sieve *s, uint64_t index, bool create)
+{
+    _Atomic(lazy_slot *) *entry = &s->blocks[index / LAZY_BLOCK_SEGMENTS];
+    lazy_slot *block = atomic_load_explicit(entry, memory_order_acquire);
+    if (block == NULL && create)
+    {
+        lazy_slot *fresh = (lazy_slot *)malloc(LAZY_BLOCK_SEGMENTS * sizeof(lazy_slot));
+        if (fresh == NULL)
+            return NULL;
+        for (uint64_t i = 0; i < LAZY_BLOCK_SEGMENTS; i++)
+            atomic_init(&fresh[i], NULL);
+        // another thread may have installed the block in the meantime: keep its one
+        if (atomic_compare_exchange_strong_explicit(entry, &block, fresh, memory_order_acq_rel,
+                                                    memory_order_acquire))
+            block = fresh;
+        else
+            free(fresh);
+    }
+    return block != NULL ? &block[index % LAZY_BLOCK_SEGMENTS] : NULL;
+}
+
+/**
+ * Base primes able to sieve up to high, grown by the first extender needing them
+ */
+static const lazy_base *base_for(lazy_sieve *s, uint64_t high)
+{
+    lazy_base *base = atomic_load_explicit(&s->base, memory_order_acquire);
+    if (base != NULL && base->high >= high)
+        return base;
+    pthread_mutex_lock(&s->base_lock);
+    base = atomic_load_explicit(&s->base, memory_order_relaxed);
+    if (base == NULL || base->high < high)
+    {
+        uint64_t grown_high = base == NULL ? FIRST_BASE_HIGH : base->high * 16;
+        if (grown_high < high)
+            grown_high = high;
+        if (grown_high > LAZY_MAX)
+            grown_high = LAZY_MAX;
+        lazy_base *grown = (lazy_base *)malloc(sizeof(lazy_base));
+        if (grown != NULL && base_primes_init(&grown->bp, isqrt(grown_high)) == 0)
+        {
+            grown->high = grown_high;
+            grown->older = base;
+            atomic_store_explicit(&s->base, grown, memory_order_release);
+            base = grown;
+        }
+        else
+        {
+            free(grown);
+            base = NULL;
+        }
+    }
+    pthread_mutex_unlock(&s->base_lock);
+    return base;
+}
+
+static lazy_segment *sieve_one(lazy_sieve *s, uint64_t index)
+{
+    uint64_t low = index * LAZY_SEGMENT_SPAN;
+    uint64_t high = low + LAZY_SEGMENT_SPAN - 1;
+    const lazy_base *base = base_for(s, high);
+    lazy_segment *seg = (lazy_segment *)malloc(sizeof(lazy_segment));
+    sieve_state st;
+    if (base == NULL || seg == NULL || sieve_state_init(&st, &base->bp, high, LAZY_SEGMENT_BYTES) != 0)
+    {
+        free(seg);
+        return NULL;
+    }
+    sieve_state_seek(&st, low);
+    seg->count = sieve_segment(&st, seg->bits, index * LAZY_SEGMENT_BYTES, LAZY_SEGMENT_BYTES, low);
+    sieve_state_free(&st);
+    return seg;
+}
+
+/**
+ * Move ready past the segments sieved right after it
+ */
+static void advance_ready(lazy_sieve *s)
+{
+    uint64_t ready = atomic_load_explicit(&s->ready, memory_order_relaxed);
+    while (ready < (uint64_t)LAZY_BLOCKS * LAZY_BLOCK_SEGMENTS)
+    {
+        lazy_slot *slot = slot_of(s, ready, false);
+        lazy_segment *seg = slot != NULL ? atomic_load_explicit(slot, memory_order_acquire) : NULL;
+        if (seg == NULL || seg == BUSY)
+            break;
+        // on failure ready holds the value another thread moved it to
+        if (atomic_compare_exchange_weak_explicit(&s->ready, &ready, ready + 1, memory_order_release,
+                                                  memory_order_relaxed))
+            ready++;
+    }
+}
+
+/**
+ * Store the segment sieved in a claimed slot, NULL to free the slot for the next thread to try
+ */
+static void publish(lazy_sieve *s, lazy_slot *slot, lazy_segment *seg)
+{
+    atomic_store_explicit(slot, seg, memory_order_release);
+    if (seg != NULL)
+    {
+        atomic_fetch_add_explicit(&s->sieved, 1, memory_order_relaxed);
+        advance_ready(s);
+    }
+}
+
+/**
+ * Segment index, sieved by this thread if nobody has claimed it
+ * @param wait when another thread is sieving the segment: wait for it, or return BUSY
+ * @return NULL if the memory could not be allocated
+ */
+static const lazy_segment *segment_get(lazy_sieve *s, uint64_t index, bool wait)
+{
+    lazy_slot *slot = slot_of(s, index, true);
+    if (slot == NULL)
+        return NULL;
+    for (;;)
+    {
+        lazy_segment *seg = atomic_load_explicit(slot, memory_order_acquire);
+        if (seg == NULL)
+        {
+            if (!atomic_compare_exchange_strong_explicit(slot, &seg, BUSY, memory_order_acquire,
+                                                         memory_order_relaxed))
+                continue;
+            seg = sieve_one(s, index);
+            publish(s, slot, seg);
+            return seg;
+        }
+        if (seg != BUSY || !wait)
+            return seg;
+        sched_yield();
+    }
+}
+
+int lazy_sieve_extend(lazy_sieve *s, uint64_t high)
+{
+    if (high > LAZY_MAX)
+        return -1;
+    uint64_t last = high / LAZY_SEGMENT_SPAN;
+    uint64_t first = atomic_load_explicit(&s->ready, memory_order_acquire);
+    if (first > last)
+        return 0;
+    // one crossing-off state for the whole run: consecutive segments carry the
+    // base primes over, it only seeks past the segments claimed by other threads
+    uint64_t end = (last + 1) * LAZY_SEGMENT_SPAN - 1;
+    const lazy_base *base = base_for(s, end);
+    sieve_state st;
+    if (base == NULL || sieve_state_init(&st, &base->bp, end, LAZY_SEGMENT_BYTES) != 0)
+        return -1;
+    uint64_t next = UINT64_MAX; // segment the state is positioned at
+    int ret = 0;
+    // sieve the free segments first, then wait for those of the other extenders
+    for (uint64_t i = first; ret == 0 && i <= last; i++)
+    {
+        lazy_slot *slot = slot_of(s, i, true);
+        lazy_segment *seg = NULL;
+        if (slot == NULL)
+            ret = -1;
+        else if (atomic_compare_exchange_strong_explicit(slot, &seg, BUSY, memory_order_acquire,
+                                                         memory_order_relaxed))
+        {
+            seg = (lazy_segment *)malloc(sizeof(lazy_segment));
+            if (seg != NULL)
+            {
+                uint64_t low = i * LAZY_SEGMENT_SPAN;
+                if (i != next)
+                    sieve_state_seek(&st, low);
+                seg->count = sieve_segment(&st, seg->bits, i * LAZY_SEGMENT_BYTES, LAZY_SEGMENT_BYTES, low);
+                next = i + 1;
+            }
+            publish(s, slot, seg);
+            ret = seg != NULL ? 0 : -1;
+        }
+    }
+    sieve_state_free(&st);
+    for (uint64_t i = first; ret == 0 && i <= last; i++)
+    {
+        if (segment_get(s, i, true) == NULL)
+            ret = -1;
+    }
+    return ret;
+}
+
+uint64_t lazy_sieve_limit(lazy_sieve *s)
+{
+    uint64_t ready = atomic_load_explicit(&s->ready, memory_order_acquire);
+    return ready > 0 ? ready * LAZY_SEGMENT_SPAN - 1 : 0;
+}
+
+int lazy_sieve_is_prime(lazy_sieve *s, uint64_t n)
+{
+    if (n > LAZY_MAX)
+        return -1;
+    uint64_t index = n / LAZY_SEGMENT_SPAN;
+    const lazy_segment *seg = segment_get(s, index, true);
+    if (seg == NULL)
+        return -1;
+    return wheel_is_prime(seg->bits, index * LAZY_SEGMENT_BYTES, n);
+}
+
+uint64_t lazy_sieve_next_prime(lazy_sieve *s, uint64_t n)
+{
+    for (uint64_t k = n; k < LAZY_MAX;)
+    {
+        uint64_t index = (k + 1) / LAZY_SEGMENT_SPAN;
+        uint64_t end = (index + 1) * LAZY_SEGMENT_SPAN - 1;
+        const lazy_segment *seg = segment_get(s, index, true);
+        if (seg == NULL)
+            return 0;
+        uint64_t p = wheel_next_prime(seg->bits, index * LAZY_SEGMENT_BYTES, end, k);
+        if (p != 0)
+            return p;
+        k = end;
+    }
+    return 0;
+}
+
+int lazy_sieve_count(lazy_sieve *s, uint64_t low, uint64_t high, uint64_t *count)
+{
+    *count = 0;
+    if (high > LAZY_MAX)
+        return -1;
+    for (uint64_t index = low / LAZY_SEGMENT_SPAN; low <= high && index <= high / LAZY_SEGMENT_SPAN; index++)
+    {
+        const lazy_segment *seg = segment_get(s, index, true);
+        if (seg == NULL)
+            return -1;
+        uint64_t seg_low = index * LAZY_SEGMENT_SPAN;
+        uint64_t seg_high = seg_low + LAZY_SEGMENT_SPAN - 1;
+        // whole segments are counted once, when they are sieved
+        if (low <= seg_low && seg_high <= high)
+            *count += seg->count + wheel_small_primes(seg_low, seg_high);
+        else
+            *count += wheel_count(seg->bits, index * LAZY_SEGMENT_BYTES, low > seg_low ? low : seg_low,
+                                  high < seg_high ? high : seg_high);
+    }
+    return 0;
+}
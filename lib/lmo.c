@@ -0,0 +1,551 @@
+#include "lmo.h"
+#include "backend.h"
+#include "segment.h"
+#include "wheel.h"
+#include "timer.h"
+#include "scheduler.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+/** Below this the plain sieve is faster than setting up the leaves */
+#define LMO_MIN_X 10000
+/** phi(n, c) is periodic in n for the first c primes, with period their product */
+#define PHI_TINY_C 6
+/** y = alpha * x^(1/3): trades the leaves (grow with y) against the sieve of [1, x / y] */
+#define LMO_ALPHA_MIN 1.0
+
+typedef struct
+{
+    uint64_t x;
+    uint64_t y;
+    uint64_t z;             // x / y
+    uint64_t a;             // pi(y)
+    uint64_t c;             // primes handled by phi_tiny
+    uint32_t *primes;       // primes[b] is the b-th prime, primes[0] is unused
+    uint32_t *lpf;          // least prime factor of n <= y, lpf[1] = UINT32_MAX
+    uint32_t *pi;           // pi(n) for n <= y
+    uint64_t sqrty;
+    int8_t *mu;             // Moebius function of n <= y
+    uint32_t pp;            // product of the first c primes
+    uint32_t totient;       // numbers < pp coprime to pp
+    uint16_t *phi_tiny;     // phi_tiny[r]: numbers in [1, r] coprime to pp
+    const atomic_bool *cancel; // checked once per segment, may be NULL
+} lmo_ctx;
+
+/**
+ * Special leaves of the numbers [low, high) of the sieve, as seen by one thread
+ *
+ * Removing a number only decrements the counter of its block of sqrt(segment)
+ * numbers: there are far more removals than leaves, and the leaves of a prime
+ * are visited in increasing order, so a cursor skips the blocks by counter.
+ * phi and mu_sum only hold what the chunk saw: the leaves also need the count of
+ * the numbers left below low, which is added once the previous chunks are done.
+ */
+typedef struct
+{
+    const lmo_ctx *L;
+    uint64_t low;
+    uint64_t high;
+    uint64_t segment_size;
+    unsigned block_log;     // log2 of the numbers per counter
+    int64_t s2;
+    uint64_t max_b;         // largest prime index with leaves in the chunk
+    int64_t *phi;           // [b]: numbers of the chunk left after removing the first b - 1 primes
+    int64_t *mu_sum;        // [b]: sum of mu(m) over the leaves p_b * m of the chunk
+    uint64_t *next;         // [b]: next multiple of p_b to cross off
+    uint8_t *sieve;
+    uint32_t *counters;     // [i]: numbers left in block i of the segment
+} s2_chunk;
+
+/**
+ * Partial sum of P2 over the values x / p in [low, high]
+ */
+typedef struct
+{
+    const lmo_ctx *L;
+    const base_primes *bp;
+    uint64_t low;
+    uint64_t high;
+    size_t b_first;         // prime indices b_first >= b >= b_last have x / p_b in [low, high]
+    size_t b_last;
+    int64_t sum;            // sum of pi(x / p_b) - b + 1 counting only the primes >= low
+    uint64_t terms;
+    uint64_t count;         // primes in [low, high]
+    int failed;
+} p2_chunk;
+
+static bool cancelled(const lmo_ctx *L)
+{
+    return L->cancel != NULL && atomic_load_explicit(L->cancel, memory_order_relaxed);
+}
+
+static uint64_t phi_tiny(const lmo_ctx *L, uint64_t n)
+{
+    return (n / L->pp) * L->totient + L->phi_tiny[n % L->pp];
+}
+
+static int lmo_init(lmo_ctx *L, const base_primes *bp, uint64_t x)
+{
+    memset(L, 0, sizeof(*L));
+    L->x = x;
+    uint64_t x13 = (uint64_t)cbrtl((long double)x);
+    // cbrtl may be off by one, compare without overflowing near 2^64
+    while (x13 * x13 > x / x13)
+        x13--;
+    while ((x13 + 1) * (x13 + 1) <= x / (x13 + 1))
+        x13++;
+    // larger x: more leaves are worth it to shrink the sieve of [1, z]
+    double alpha = log((double)x) / 4;
+    if (alpha < LMO_ALPHA_MIN)
+        alpha = LMO_ALPHA_MIN;
+    L->y = (uint64_t)(alpha * x13);
+    if (L->y > isqrt(x))
+        L->y = isqrt(x);
+    L->z = x / L->y;
+    while (L->a < bp->count && bp->primes[L->a] <= L->y)
+        L->a++;
+    L->c = L->a < PHI_TINY_C ? L->a : PHI_TINY_C;
+
+    L->primes = (uint32_t *)malloc((L->a + 1) * sizeof(uint32_t));
+    L->lpf = (uint32_t *)calloc(L->y + 1, sizeof(uint32_t));
+    L->mu = (int8_t *)malloc(L->y + 1);
+    L->pi = (uint32_t *)malloc((L->y + 1) * sizeof(uint32_t));
+    L->sqrty = isqrt(L->y);
+    L->pp = 1;
+    for (uint64_t b = 0; b < L->c; b++)
+        L->pp *= bp->primes[b];
+    L->phi_tiny = (uint16_t *)malloc(L->pp * sizeof(uint16_t));
+    if (L->primes == NULL || L->lpf == NULL || L->mu == NULL || L->pi == NULL || L->phi_tiny == NULL)
+        return -1;
+    L->primes[0] = 0;
+    memcpy(L->primes + 1, bp->primes, L->a * sizeof(uint32_t));
+
+    memset(L->mu, 1, L->y + 1);
+    for (uint64_t b = 1; b <= L->a; b++)
+    {
+        uint64_t p = L->primes[b];
+        for (uint64_t m = p; m <= L->y; m += p)
+        {
+            if (L->lpf[m] == 0)
+                L->lpf[m] = (uint32_t)p;
+            L->mu[m] = -L->mu[m];
+        }
+        for (uint64_t m = p * p; m <= L->y; m += p * p)
+            L->mu[m] = 0;
+    }
+    L->lpf[1] = UINT32_MAX;
+    for (uint64_t n = 0, b = 0; n <= L->y; n++)
+    {
+        b += b < L->a && L->primes[b + 1] == n;
+        L->pi[n] = (uint32_t)b;
+    }
+
+    uint32_t count = 0;
+    for (uint32_t r = 0; r < L->pp; r++)
+    {
+        bool coprime = r > 0;
+        for (uint64_t b = 1; b <= L->c && coprime; b++)
+            coprime = r % L->primes[b] != 0;
+        count += coprime;
+        L->phi_tiny[r] = (uint16_t)count;
+    }
+    L->totient = count;
+    return 0;
+}
+
+static void lmo_free(lmo_ctx *L)
+{
+    free(L->primes);
+    free(L->lpf);
+    free(L->mu);
+    free(L->pi);
+    free(L->phi_tiny);
+}
+
+/**
+ * Ordinary leaves: mu(n) phi(x / n, c) for the squarefree n <= y without any of the first c primes
+ */
+static int64_t s1(const lmo_ctx *L)
+{
+    int64_t sum = 0;
+    uint64_t pc = L->primes[L->c];
+    for (uint64_t n = 1; n <= L->y; n++)
+    {
+        if (L->mu[n] != 0 && L->lpf[n] > pc)
+            sum += L->mu[n] * (int64_t)phi_tiny(L, L->x / n);
+    }
+    return sum;
+}
+
+/**
+ * Numbers left in sieve[from, to)
+ */
+static int64_t count_left(const uint8_t *sieve, uint64_t from, uint64_t to)
+{
+    int64_t left = 0;
+    for (uint64_t i = from; i < to; i++)
+        left += sieve[i];
+    return left;
+}
+
+/**
+ * Numbers left in the segment below a position, moving forward only
+ */
+typedef struct
+{
+    uint64_t pos;
+    int64_t left;           // numbers left in [low, low + pos)
+} s2_cursor;
+
+/**
+ * Leaf p_b * m with mu(m) = mu and x / (p_b m) = low + pos - 1
+ */
+static void s2_leaf(s2_chunk *ch, s2_cursor *cur, uint64_t b, uint64_t pos, int mu)
+{
+    uint64_t block = (uint64_t)1 << ch->block_log;
+    uint64_t next_block = (cur->pos | (block - 1)) + 1;
+    if (next_block <= pos)
+    {
+        cur->left += count_left(ch->sieve, cur->pos, next_block);
+        for (cur->pos = next_block; cur->pos + block <= pos; cur->pos += block)
+            cur->left += ch->counters[cur->pos >> ch->block_log];
+    }
+    cur->left += count_left(ch->sieve, cur->pos, pos);
+    cur->pos = pos;
+    ch->s2 -= mu * (ch->phi[b] + cur->left);
+    ch->mu_sum[b] += mu;
+}
+
+static void s2_sieve_chunk(s2_chunk *ch)
+{
+    const lmo_ctx *L = ch->L;
+    uint64_t block = (uint64_t)1 << ch->block_log;
+    ch->s2 = 0;
+    ch->max_b = 0;
+    memset(ch->phi, 0, (L->a + 1) * sizeof(int64_t));
+    memset(ch->mu_sum, 0, (L->a + 1) * sizeof(int64_t));
+    for (uint64_t b = 1; b < L->a; b++)
+        ch->next[b] = (ch->low + L->primes[b] - 1) / L->primes[b] * L->primes[b];
+
+    for (uint64_t low = ch->low; low < ch->high && !cancelled(L); low += ch->segment_size)
+    {
+        uint64_t high = ch->high - low < ch->segment_size ? ch->high : low + ch->segment_size;
+        uint64_t n = high - low;
+        // remove the first c primes, phi_tiny stands for them
+        memset(ch->sieve, 1, n);
+        for (uint64_t b = 1; b <= L->c; b++)
+        {
+            uint64_t k = ch->next[b];
+            for (; k < high; k += L->primes[b])
+                ch->sieve[k - low] = 0;
+            ch->next[b] = k;
+        }
+        int64_t unsieved = 0;
+        for (uint64_t i = 0; i < n; i += block)
+        {
+            uint32_t left = (uint32_t)count_left(ch->sieve, i, n - i < block ? n : i + block);
+            ch->counters[i >> ch->block_log] = left;
+            unsieved += left;
+        }
+
+        for (uint64_t b = L->c + 1; b < L->a; b++)
+        {
+            // the first segments hold most of the leaves: check every few primes
+            if (b % 256 == 0 && cancelled(L))
+                break;
+            uint64_t p = L->primes[b];
+            uint64_t xp = L->x / p;
+            // leaves p * m with x / (p * m) in [low, high) and m in (y / p, y]
+            uint64_t min_m = xp / high > L->y / p ? xp / high : L->y / p;
+            uint64_t max_m = xp / low < L->y ? xp / low : L->y;
+            if (p >= max_m) // the larger primes have no leaf left in this segment or the next ones
+                break;
+            s2_cursor cur = {0, 0};
+            if (p > L->sqrty)
+            {
+                // m <= y < p^2 without a prime factor <= p is a prime > p
+                uint64_t j_min = min_m >= max_m ? L->pi[max_m] : L->pi[min_m > p ? min_m : p];
+                for (uint64_t j = L->pi[max_m]; j > j_min; j--)
+                    s2_leaf(ch, &cur, b, xp / L->primes[j] - low + 1, -1);
+            }
+            else
+            {
+                for (uint64_t m = max_m; m > min_m; m--)
+                {
+                    if (L->mu[m] != 0 && p < L->lpf[m])
+                        s2_leaf(ch, &cur, b, xp / m - low + 1, L->mu[m]);
+                }
+            }
+            ch->phi[b] += unsieved;
+            if (b > ch->max_b)
+                ch->max_b = b;
+            uint64_t k = ch->next[b];
+            for (; k < high; k += p)
+            {
+                if (ch->sieve[k - low])
+                {
+                    ch->sieve[k - low] = 0;
+                    ch->counters[(k - low) >> ch->block_log]--;
+                    unsieved--;
+                }
+            }
+            ch->next[b] = k;
+        }
+    }
+}
+
+/**
+ * Worker of a round: one chunk each, the chunk of a worker whose thread could not start is stolen
+ */
+static int s2_worker(segment_scheduler *sched, int id, void *arg)
+{
+    s2_chunk *chunks = (s2_chunk *)arg;
+    uint64_t t;
+    bool contiguous;
+    while (scheduler_next(sched, id, &t, &contiguous))
+        s2_sieve_chunk(&chunks[t]);
+    return 0;
+}
+
+/**
+ * Special leaves: the chunks of a round run in parallel, then their partial sums
+ * are completed in order with the numbers left below each chunk. The chunks grow
+ * each round as the leaves get sparser.
+ */
+static int s2(const lmo_ctx *L, int n_threads, int64_t *result)
+{
+    uint64_t limit = L->z + 1; // sieve [1, z]
+    uint64_t segment_size = 64;
+    unsigned block_log = 3;
+    while (segment_size * segment_size < limit)
+    {
+        segment_size *= 2;
+        block_log += segment_size > ((uint64_t)1 << (2 * block_log)); // block ~ sqrt(segment)
+    }
+    s2_chunk *chunks = (s2_chunk *)calloc(n_threads, sizeof(s2_chunk));
+    int64_t *phi = (int64_t *)calloc(L->a + 1, sizeof(int64_t)); // numbers left below the current chunk
+    int ret = chunks == NULL || phi == NULL ? -1 : 0;
+    for (int t = 0; ret == 0 && t < n_threads; t++)
+    {
+        chunks[t].L = L;
+        chunks[t].segment_size = segment_size;
+        chunks[t].block_log = block_log;
+        chunks[t].phi = (int64_t *)malloc((L->a + 1) * sizeof(int64_t));
+        chunks[t].mu_sum = (int64_t *)malloc((L->a + 1) * sizeof(int64_t));
+        chunks[t].next = (uint64_t *)malloc((L->a + 1) * sizeof(uint64_t));
+        chunks[t].sieve = (uint8_t *)malloc(segment_size);
+        chunks[t].counters = (uint32_t *)malloc((segment_size >> block_log) * sizeof(uint32_t));
+        if (chunks[t].phi == NULL || chunks[t].mu_sum == NULL || chunks[t].next == NULL ||
+            chunks[t].sieve == NULL || chunks[t].counters == NULL)
+            ret = -1;
+    }
+
+    int64_t sum = 0;
+    uint64_t low = 1;
+    uint64_t segments = 1;
+    while (ret == 0 && low < limit)
+    {
+        int n_chunks = 0;
+        for (; n_chunks < n_threads && low < limit; n_chunks++)
+        {
+            chunks[n_chunks].low = low;
+            low = limit - low < segments * segment_size ? limit : low + segments * segment_size;
+            chunks[n_chunks].high = low;
+        }
+        if (scheduler_run(n_chunks, n_chunks, s2_worker, chunks) != 0)
+        {
+            ret = -1;
+            break;
+        }
+        for (int t = 0; t < n_chunks; t++)
+        {
+            sum += chunks[t].s2;
+            for (uint64_t b = 1; b <= chunks[t].max_b; b++)
+            {
+                sum -= chunks[t].mu_sum[b] * phi[b];
+                phi[b] += chunks[t].phi[b];
+            }
+        }
+        segments *= 2;
+        // the partial sums of a cancelled round are incomplete
+        if (cancelled(L))
+            ret = -1;
+    }
+    for (int t = 0; chunks != NULL && t < n_threads; t++)
+    {
+        free(chunks[t].phi);
+        free(chunks[t].mu_sum);
+        free(chunks[t].next);
+        free(chunks[t].sieve);
+        free(chunks[t].counters);
+    }
+    free(chunks);
+    free(phi);
+    *result = sum;
+    return ret;
+}
+
+static void p2_sieve_chunk(p2_chunk *ch)
+{
+    const lmo_ctx *L = ch->L;
+    uint8_t *segment = (uint8_t *)malloc(SEGMENT_BYTES);
+    sieve_state st;
+    if (segment == NULL || sieve_state_init(&st, ch->bp, ch->high, SEGMENT_BYTES) != 0)
+    {
+        free(segment);
+        ch->failed = 1;
+        return;
+    }
+    sieve_state_seek(&st, ch->low);
+    size_t b = ch->b_first;
+    uint64_t count = 0;        // primes in [low, cursor)
+    uint64_t cursor = ch->low;
+    uint64_t first = ch->low / WHEEL_SPAN;
+    uint64_t last = ch->high / WHEEL_SPAN;
+    for (uint64_t byte = first; byte <= last; byte += SEGMENT_BYTES)
+    {
+        uint64_t n_bytes = last - byte + 1 < SEGMENT_BYTES ? last - byte + 1 : SEGMENT_BYTES;
+        sieve_segment(&st, segment, byte, n_bytes, ch->low);
+        uint64_t seg_high = byte + n_bytes - 1 == last ? ch->high : (byte + n_bytes) * WHEEL_SPAN - 1;
+        // x / p_b grows as b decreases
+        for (; b >= ch->b_last && b > 0 && L->x / ch->bp->primes[b - 1] <= seg_high; b--)
+        {
+            uint64_t v = L->x / ch->bp->primes[b - 1];
+            count += wheel_count(segment, byte, cursor, v);
+            cursor = v + 1;
+            ch->sum += (int64_t)count - (int64_t)b + 1;
+            ch->terms++;
+        }
+        count += wheel_count(segment, byte, cursor, seg_high);
+        cursor = seg_high + 1;
+        if (last - byte < SEGMENT_BYTES)
+            break;
+        if (cancelled(L))
+        {
+            ch->failed = 1;
+            break;
+        }
+    }
+    ch->count = count;
+    sieve_state_free(&st);
+    free(segment);
+}
+
+static int p2_worker(segment_scheduler *sched, int id, void *arg)
+{
+    p2_chunk *chunks = (p2_chunk *)arg;
+    uint64_t t;
+    bool contiguous;
+    while (scheduler_next(sched, id, &t, &contiguous))
+        p2_sieve_chunk(&chunks[t]);
+    return 0;
+}
+
+/**
+ * P2(x, a): numbers <= x with two prime factors > y, sum of pi(x / p) - pi(p) + 1 for y < p <= sqrt(x)
+ */
+static int p2(const lmo_ctx *L, const base_primes *bp, int n_threads, int64_t *result)
+{
+    uint64_t sqrtx = isqrt(L->x);
+    size_t pi_sqrtx = bp->count; // bp holds the primes <= sqrt(x)
+    int64_t sum = 0;
+    // primes are 1-based here: b is the index of p_b = bp->primes[b - 1]
+    size_t b = pi_sqrtx;
+    for (; b > L->a && L->x / bp->primes[b - 1] <= sqrtx; b--)
+        sum += (int64_t)pi_sqrtx - (int64_t)b + 1;
+    if (b <= L->a)
+    {
+        *result = sum;
+        return 0;
+    }
+
+    // split [sqrt(x) + 1, x / p_(a+1)] evenly among the threads
+    uint64_t low = sqrtx + 1;
+    uint64_t high = L->x / bp->primes[L->a];
+    p2_chunk *chunks = (p2_chunk *)calloc(n_threads, sizeof(p2_chunk));
+    if (chunks == NULL)
+        return -1;
+    uint64_t span = high - low + 1;
+    int n_chunks = 0;
+    for (int t = 0; t < n_threads; t++)
+    {
+        uint64_t chunk_low = low + BLOCK_LOW(t, n_threads, span);
+        uint64_t chunk_high = low + BLOCK_HIGH(t, n_threads, span);
+        if (chunk_low > chunk_high)
+            continue;
+        p2_chunk *ch = &chunks[n_chunks++];
+        ch->L = L;
+        ch->bp = bp;
+        ch->low = chunk_low;
+        ch->high = chunk_high;
+        ch->b_first = b;
+        while (b > L->a && L->x / bp->primes[b - 1] <= chunk_high)
+            b--;
+        ch->b_last = b + 1;
+    }
+    int ret = scheduler_run(n_chunks, n_chunks, p2_worker, chunks);
+    uint64_t pi_low = pi_sqrtx; // pi(chunk low - 1)
+    for (int t = 0; t < n_chunks; t++)
+    {
+        if (chunks[t].failed)
+            ret = -1;
+        sum += chunks[t].sum + (int64_t)(chunks[t].terms * pi_low);
+        pi_low += chunks[t].count;
+    }
+    free(chunks);
+    *result = sum;
+    return ret;
+}
+
+int lmo_pi(uint64_t x, int n_threads, uint64_t *pi)
+{
+    return lmo_pi_cancellable(x, n_threads, NULL, pi);
+}
+
+int lmo_pi_cancellable(uint64_t x, int n_threads, const atomic_bool *cancel, uint64_t *pi)
+{
+    if (n_threads <= 0)
+        n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    base_primes bp;
+    if (x < LMO_MIN_X)
+    {
+        if (base_primes_init(&bp, isqrt(x)) != 0)
+            return -1;
+        int ret = segmented_count(0, x, &bp, 0, pi);
+        *pi += wheel_small_primes(0, x);
+        base_primes_free(&bp);
+        return ret;
+    }
+    if (base_primes_init(&bp, isqrt(x)) != 0)
+        return -1;
+    lmo_ctx L;
+    int64_t sum_s2 = 0, sum_p2 = 0;
+    int ret = lmo_init(&L, &bp, x);
+    L.cancel = cancel;
+    if (ret == 0)
+        ret = s2(&L, n_threads, &sum_s2);
+    if (ret == 0)
+        ret = p2(&L, &bp, n_threads, &sum_p2);
+    if (ret == 0)
+        *pi = (uint64_t)(s1(&L) + sum_s2 + (int64_t)L.a - 1 - sum_p2);
+    lmo_free(&L);
+    base_primes_free(&bp);
+    return ret;
+}
+
+int lmo_run(const sieve_config *cfg, sieve_result *res)
+{
+    double start, end;
+    GET_TIME(start);
+    int n_threads = backend_threads(cfg);
+    uint64_t pi_max, pi_min = 0;
+    if (lmo_pi(cfg->max, n_threads, &pi_max) != 0 || (cfg->min > 0 && lmo_pi(cfg->min - 1, n_threads, &pi_min) != 0))
+        return -1;
+    GET_TIME(end);
+    res->count = pi_max - pi_min;
+    res->elapsed = end - start;
+    return 0;
+}
@@ -0,0 +1,137 @@
+#include "numbers.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/** Bytes read from the input at a time */
+#define READ_BYTES (1 << 20)
+
+static bool is_space(uint8_t c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static int push(uint64_t **numbers, size_t *n, size_t *capacity, uint64_t value)
+{
+    if (*n == *capacity)
+    {
+        uint64_t *grown = (uint64_t *)realloc(*numbers, *capacity * 2 * sizeof(uint64_t));
+        if (grown == NULL)
+            return -1;
+        *numbers = grown;
+        *capacity *= 2;
+    }
+    (*numbers)[(*n)++] = value;
+    return 0;
+}
+
+int numbers_read(FILE *f, uint64_t **numbers, size_t *n)
+{
+    uint8_t *buffer = (uint8_t *)malloc(READ_BYTES);
+    size_t capacity = 1 << 16;
+    *numbers = (uint64_t *)malloc(capacity * sizeof(uint64_t));
+    *n = 0;
+    if (buffer == NULL || *numbers == NULL)
+        goto fail;
+    uint64_t value = 0;
+    bool in_number = false;
+    size_t size;
+    // a number cut at the end of the buffer continues in the next read
+    while ((size = fread(buffer, 1, READ_BYTES, f)) > 0)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            unsigned digit = buffer[i] - '0';
+            if (digit < 10)
+            {
+                if (value > (UINT64_MAX - digit) / 10)
+                    goto fail;
+                value = value * 10 + digit;
+                in_number = true;
+            }
+            else if (!is_space(buffer[i]))
+                goto fail;
+            else if (in_number)
+            {
+                if (push(numbers, n, &capacity, value) != 0)
+                    goto fail;
+                value = 0;
+                in_number = false;
+            }
+        }
+    }
+    if (ferror(f) || (in_number && push(numbers, n, &capacity, value) != 0))
+        goto fail;
+    free(buffer);
+    return 0;
+
+fail:
+    free(buffer);
+    free(*numbers);
+    *numbers = NULL;
+    *n = 0;
+    return -1;
+}
+
+/**
+ * value = value * 10 + digit
+ * @return 0 on success, -1 past 64 bits
+ */
+static int append_digit(uint64_t *value, unsigned digit)
+{
+    if (*value > (UINT64_MAX - digit) / 10)
+        return -1;
+    *value = *value * 10 + digit;
+    return 0;
+}
+
+int numbers_parse(const char *s, uint64_t *value)
+{
+    // mantissa digits without the point, then the exponent less the digits after the point
+    uint64_t mantissa = 0;
+    int64_t exponent = 0;
+    int digits = 0;
+    for (; *s >= '0' && *s <= '9'; s++, digits++)
+    {
+        if (append_digit(&mantissa, *s - '0') != 0)
+            return -1;
+    }
+    if (*s == '.')
+    {
+        for (s++; *s >= '0' && *s <= '9'; s++, digits++)
+        {
+            if (append_digit(&mantissa, *s - '0') != 0)
+                return -1;
+            exponent--;
+        }
+    }
+    if (digits == 0)
+        return -1;
+    if (*s == 'e' || *s == 'E')
+    {
+        uint64_t e = 0;
+        if (*++s == '\0')
+            return -1;
+        for (; *s >= '0' && *s <= '9'; s++)
+        {
+            if (append_digit(&e, *s - '0') != 0 || e > 64)
+                return -1;
+        }
+        exponent += (int64_t)e;
+    }
+    if (*s != '\0')
+        return -1;
+    for (; exponent < 0; exponent++)
+    {
+        if (mantissa % 10 != 0)
+            return -1; // not a whole number
+        mantissa /= 10;
+    }
+    for (; exponent > 0 && mantissa != 0; exponent--)
+    {
+        if (append_digit(&mantissa, 0) != 0)
+            return -1;
+    }
+    *value = mantissa;
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "popcount.h"
+
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define POPCOUNT_X86
+#include <immintrin.h>
+#endif
+
+typedef uint64_t (*popcount_fn)(const uint8_t *bytes, uint64_t n);
+
+static uint64_t popcount_tail(const uint8_t *bytes, uint64_t n)
+{
+    uint64_t count = 0;
+    for (uint64_t i = 0; i < n; i++)
+        count += __builtin_popcount(bytes[i]);
+    return count;
+}
+
+/**
+ * Four independent accumulators keep several popcounts in flight
+ */
+#define POPCOUNT_WORDS_BODY                                \
+    uint64_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;               \
+    uint64_t i = 0;                                        \
+    for (; i + 32 <= n; i += 32)                           \
+    {                                                      \
+        uint64_t w[4];                                     \
+        memcpy(w, bytes + i, sizeof(w));                   \
+        c0 += __builtin_popcountll(w[0]);                  \
+        c1 += __builtin_popcountll(w[1]);                  \
+        c2 += __builtin_popcountll(w[2]);                  \
+        c3 += __builtin_popcountll(w[3]);                  \
+    }                                                      \
+    return c0 + c1 + c2 + c3 + popcount_tail(bytes + i, n - i);
+
+static uint64_t popcount_generic(const uint8_t *bytes, uint64_t n)
+{
+    POPCOUNT_WORDS_BODY
+}
+
+#ifdef POPCOUNT_X86
+__attribute__((target("popcnt"))) static uint64_t popcount_popcnt(const uint8_t *bytes, uint64_t n)
+{
+    POPCOUNT_WORDS_BODY
+}
+
+/**
+ * Mula's algorithm: 4 bit lookups with vpshufb, horizontal sums with vpsadbw
+ */
+__attribute__((target("avx2,popcnt"))) static uint64_t popcount_avx2(const uint8_t *bytes, uint64_t n)
+{
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    __m256i total = _mm256_setzero_si256();
+    uint64_t i = 0;
+    while (i + 32 <= n)
+    {
+        // byte counters hold at most 8 * 31 before they have to be widened
+        __m256i local = _mm256_setzero_si256();
+        for (int k = 0; k < 31 && i + 32 <= n; k++, i += 32)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(bytes + i));
+            __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low_mask));
+            __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask));
+            local = _mm256_add_epi8(local, _mm256_add_epi8(lo, hi));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(local, _mm256_setzero_si256()));
+    }
+    uint64_t count = (uint64_t)_mm256_extract_epi64(total, 0) + (uint64_t)_mm256_extract_epi64(total, 1) +
+                     (uint64_t)_mm256_extract_epi64(total, 2) + (uint64_t)_mm256_extract_epi64(total, 3);
+    return count + popcount_popcnt(bytes + i, n - i);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq,popcnt"))) static uint64_t popcount_avx512(const uint8_t *bytes, uint64_t n)
+{
+    __m512i total = _mm512_setzero_si512();
+    uint64_t i = 0;
+    for (; i + 64 <= n; i += 64)
+    {
+        __m512i v = _mm512_loadu_si512((const void *)(bytes + i));
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(v));
+    }
+    return (uint64_t)_mm512_reduce_add_epi64(total) + popcount_popcnt(bytes + i, n - i);
+}
+#endif
+
+static popcount_fn popcount_selected = popcount_generic;
+static const char *popcount_name = "generic";
+static pthread_once_t popcount_once = PTHREAD_ONCE_INIT;
+
+static void popcount_select(void)
+{
+#ifdef POPCOUNT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512vpopcntdq"))
+    {
+        popcount_selected = popcount_avx512;
+        popcount_name = "avx512-vpopcntdq";
+    }
+    else if (__builtin_cpu_supports("avx2"))
+    {
+        popcount_selected = popcount_avx2;
+        popcount_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("popcnt"))
+    {
+        popcount_selected = popcount_popcnt;
+        popcount_name = "popcnt";
+    }
+#endif
+}
+
+uint64_t popcount_bytes(const uint8_t *bytes, uint64_t n)
+{
+    pthread_once(&popcount_once, popcount_select);
+    return popcount_selected(bytes, n);
+}
+
+const char *popcount_impl(void)
+{
+    pthread_once(&popcount_once, popcount_select);
+    return popcount_name;
+}
@@ -0,0 +1,391 @@
+#include "primality.h"
+#include "segment.h"
+#include "wheel.h"
+#include "scheduler.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** GCC extension, needed for the 64 x 64 -> 128 bit products */
+__extension__ typedef unsigned __int128 uint128_t;
+
+/**
+ * Odd primes < 64 with their inverse mod 2^64 and floor((2^64 - 1) / p):
+ * p divides n iff n * inverse mod 2^64 <= that bound, a multiplication instead of a division
+ */
+static const struct
+{
+    uint64_t p;
+    uint64_t inverse;
+    uint64_t bound;
+} trial_primes[] = {
+    {3, 0xaaaaaaaaaaaaaaabu, 0x5555555555555555u},  {5, 0xcccccccccccccccdu, 0x3333333333333333u},
+    {7, 0x6db6db6db6db6db7u, 0x2492492492492492u},  {11, 0x2e8ba2e8ba2e8ba3u, 0x1745d1745d1745d1u},
+    {13, 0x4ec4ec4ec4ec4ec5u, 0x13b13b13b13b13b1u}, {17, 0xf0f0f0f0f0f0f0f1u, 0x0f0f0f0f0f0f0f0fu},
+    {19, 0x86bca1af286bca1bu, 0x0d79435e50d79435u}, {23, 0xd37a6f4de9bd37a7u, 0x0b21642c8590b216u},
+    {29, 0x34f72c234f72c235u, 0x08d3dcb08d3dcb08u}, {31, 0xef7bdef7bdef7bdfu, 0x0842108421084210u},
+    {37, 0x14c1bacf914c1badu, 0x06eb3e45306eb3e4u}, {41, 0x8f9c18f9c18f9c19u, 0x063e7063e7063e70u},
+    {43, 0x82fa0be82fa0be83u, 0x05f417d05f417d05u}, {47, 0x51b3bea3677d46cfu, 0x0572620ae4c415c9u},
+    {53, 0x21cfb2b78c13521du, 0x04d4873ecade304du}, {59, 0xcbeea4e1a08ad8f3u, 0x0456c797dd49c341u},
+    {61, 0x4fbcda3ac10c9715u, 0x04325c53ef368eb0u},
+};
+
+#define N_TRIAL_PRIMES (sizeof(trial_primes) / sizeof(trial_primes[0]))
+/** Below its square, a number without a factor in trial_primes is prime */
+#define TRIAL_LIMIT 67
+
+/**
+ * Bases of the strong probable prime tests: no composite below bound passes all of them
+ */
+static const struct
+{
+    uint64_t bound;
+    int n_bases;
+    uint64_t bases[7];
+} base_sets[] = {
+    {UINT64_C(25326001), 3, {2, 3, 5}},
+    {UINT64_C(3215031751), 4, {2, 3, 5, 7}},
+    {UINT64_C(2152302898747), 5, {2, 3, 5, 7, 11}},
+    {UINT64_C(3474749660383), 6, {2, 3, 5, 7, 11, 13}},
+    {UINT64_C(341550071728321), 7, {2, 3, 5, 7, 11, 13, 17}},
+    // past the largest base: none is a multiple of n
+    {UINT64_MAX, 7, {2, 325, 9375, 28178, 450775, 9780504, 1795265022}},
+};
+
+/**
+ * Odd modulus n in Montgomery form, R = 2^64
+ */
+typedef struct
+{
+    uint64_t n;
+    uint64_t inverse;   // n^-1 mod 2^64
+    uint64_t one;       // R mod n
+    uint64_t minus_one; // -R mod n
+    uint64_t r2;        // R^2 mod n, to convert into Montgomery form
+} mont_ctx;
+
+static void mont_init(mont_ctx *m, uint64_t n)
+{
+    m->n = n;
+    // Newton's iteration doubles the correct low bits, n * n = 1 mod 8 gives the first 3
+    uint64_t x = n;
+    for (int i = 0; i < 5; i++)
+        x *= 2 - n * x;
+    m->inverse = x;
+    m->one = (0 - n) % n;
+    m->minus_one = n - m->one;
+    m->r2 = (uint64_t)((uint128_t)m->one * m->one % n);
+}
+
+/**
+ * a * b / R mod n for a, b < n: the low words of a * b and m * n cancel out
+ */
+static inline uint64_t mont_mul(uint64_t a, uint64_t b, uint64_t n, uint64_t inverse)
+{
+    uint128_t t = (uint128_t)a * b;
+    uint64_t m = (uint64_t)t * inverse;
+    uint64_t high = (uint64_t)(t >> 64);
+    uint64_t mn = (uint64_t)(((uint128_t)m * n) >> 64);
+    return high >= mn ? high - mn : high - mn + n;
+}
+
+/**
+ * @return true when trial division decides, with the answer in *prime
+ */
+static inline bool trial_division(uint64_t n, bool *prime)
+{
+    if (n < 4)
+    {
+        *prime = n >= 2;
+        return true;
+    }
+    if (n % 2 == 0)
+    {
+        *prime = false;
+        return true;
+    }
+    for (size_t i = 0; i < N_TRIAL_PRIMES; i++)
+    {
+        if (n * trial_primes[i].inverse <= trial_primes[i].bound)
+        {
+            *prime = n == trial_primes[i].p;
+            return true;
+        }
+    }
+    *prime = true;
+    return n < TRIAL_LIMIT * TRIAL_LIMIT;
+}
+
+static inline int base_set(uint64_t n)
+{
+    int i = 0;
+    while (n >= base_sets[i].bound)
+        i++;
+    return i;
+}
+
+/**
+ * Strong probable prime test of odd n to base a, with n - 1 = d * 2^s
+ */
+static bool strong_probable_prime(const mont_ctx *m, uint64_t a, uint64_t d, int s)
+{
+    uint64_t base = mont_mul(a % m->n, m->r2, m->n, m->inverse);
+    uint64_t x = m->one;
+    for (int bit = 63 - __builtin_clzll(d); bit >= 0; bit--)
+    {
+        x = mont_mul(x, x, m->n, m->inverse);
+        if ((d >> bit) & 1)
+            x = mont_mul(x, base, m->n, m->inverse);
+    }
+    if (x == m->one || x == m->minus_one)
+        return true;
+    for (int r = 1; r < s; r++)
+    {
+        x = mont_mul(x, x, m->n, m->inverse);
+        if (x == m->minus_one)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Tests to the bases of n from the first-th on, n odd and past trial division
+ */
+static bool miller_rabin(uint64_t n, int first)
+{
+    mont_ctx m;
+    mont_init(&m, n);
+    uint64_t d = n - 1;
+    int s = __builtin_ctzll(d);
+    d >>= s;
+    int set = base_set(n);
+    for (int i = first; i < base_sets[set].n_bases; i++)
+    {
+        if (!strong_probable_prime(&m, base_sets[set].bases[i], d, s))
+            return false;
+    }
+    return true;
+}
+
+bool prime_test(uint64_t n)
+{
+    bool prime;
+    if (trial_division(n, &prime))
+        return prime;
+    return miller_rabin(n, 0);
+}
+
+/**
+ * Base 2 test of PRIME_BATCH_LANES numbers in lockstep: a single test is one
+ * chain of dependent products, the lanes keep the multiplier busy. Every lane
+ * runs as many squarings as the longest exponent; multiplying by the base is
+ * a modular doubling, kept where the exponent bit is set.
+ */
+static void base2_lanes(const uint64_t *n, bool *pass)
+{
+    uint64_t inverse[PRIME_BATCH_LANES], x[PRIME_BATCH_LANES], d[PRIME_BATCH_LANES];
+    uint64_t one[PRIME_BATCH_LANES], minus_one[PRIME_BATCH_LANES];
+    int s[PRIME_BATCH_LANES];
+    int top = 0;
+    for (int l = 0; l < PRIME_BATCH_LANES; l++)
+    {
+        mont_ctx m;
+        mont_init(&m, n[l]);
+        inverse[l] = m.inverse;
+        one[l] = m.one;
+        minus_one[l] = m.minus_one;
+        s[l] = __builtin_ctzll(n[l] - 1);
+        d[l] = (n[l] - 1) >> s[l];
+        x[l] = one[l];
+        int bits = 64 - __builtin_clzll(d[l]);
+        top = bits > top ? bits : top;
+    }
+    for (int bit = top - 1; bit >= 0; bit--)
+    {
+        for (int l = 0; l < PRIME_BATCH_LANES; l++)
+        {
+            uint64_t sq = mont_mul(x[l], x[l], n[l], inverse[l]);
+            uint64_t doubled = sq >= n[l] - sq ? sq - (n[l] - sq) : sq + sq;
+            x[l] = (d[l] >> bit) & 1 ? doubled : sq;
+        }
+    }
+    for (int l = 0; l < PRIME_BATCH_LANES; l++)
+    {
+        pass[l] = x[l] == one[l] || x[l] == minus_one[l];
+        for (int r = 1; r < s[l] && !pass[l]; r++)
+        {
+            x[l] = mont_mul(x[l], x[l], n[l], inverse[l]);
+            pass[l] = x[l] == minus_one[l];
+        }
+    }
+}
+
+typedef struct
+{
+    const uint64_t *numbers;
+    size_t n;
+    bool *results;
+    const base_primes *bp;
+    const bool *dense;      // per window below PRIME_BATCH_SIEVE_LIMIT: sieved rather than tested
+    const size_t *order;    // indices of the numbers in dense windows, grouped by window
+    const size_t *start;    // per dense window: its first entry in order, start[n_dense] = end
+    const uint64_t *window; // per dense window: its index
+    size_t n_dense;
+} batch_task;
+
+static bool in_dense_window(const batch_task *w, uint64_t x)
+{
+    return x < PRIME_BATCH_SIEVE_LIMIT && w->dense[x / PRIME_BATCH_WINDOW];
+}
+
+/**
+ * Sieve one dense window and look its numbers up, or test them one by one without memory for the sieve
+ */
+static void batch_window(const batch_task *w, size_t k, uint8_t *bits)
+{
+    uint64_t low = w->window[k] * PRIME_BATCH_WINDOW;
+    sieve_state st;
+    bool sieved = bits != NULL && sieve_state_init(&st, w->bp, low + PRIME_BATCH_WINDOW - 1, 0) == 0;
+    if (sieved)
+    {
+        sieve_state_seek(&st, low);
+        sieve_segment(&st, bits, low / WHEEL_SPAN, PRIME_BATCH_WINDOW / WHEEL_SPAN, low);
+        sieve_state_free(&st);
+    }
+    for (size_t i = w->start[k]; i < w->start[k + 1]; i++)
+    {
+        size_t index = w->order[i];
+        uint64_t x = w->numbers[index];
+        w->results[index] = sieved ? wheel_is_prime(bits, low / WHEEL_SPAN, x) : prime_test(x);
+    }
+}
+
+/**
+ * Test the numbers of chunk c outside the dense windows
+ */
+static void batch_chunk(const batch_task *w, uint64_t c)
+{
+    size_t end = (c + 1) * PRIME_BATCH_CHUNK < w->n ? (c + 1) * PRIME_BATCH_CHUNK : w->n;
+    uint64_t lanes[PRIME_BATCH_LANES];
+    size_t lane_index[PRIME_BATCH_LANES];
+    int n_lanes = 0;
+    for (size_t i = c * PRIME_BATCH_CHUNK; i < end; i++)
+    {
+        uint64_t x = w->numbers[i];
+        bool prime;
+        if (in_dense_window(w, x))
+            continue;
+        if (trial_division(x, &prime))
+        {
+            w->results[i] = prime;
+            continue;
+        }
+        lanes[n_lanes] = x;
+        lane_index[n_lanes++] = i;
+        if (n_lanes < PRIME_BATCH_LANES)
+            continue;
+        bool pass[PRIME_BATCH_LANES];
+        base2_lanes(lanes, pass);
+        // most composites fail base 2, the survivors are mostly primes
+        for (int l = 0; l < PRIME_BATCH_LANES; l++)
+            w->results[lane_index[l]] = pass[l] && miller_rabin(lanes[l], 1);
+        n_lanes = 0;
+    }
+    for (int l = 0; l < n_lanes; l++)
+        w->results[lane_index[l]] = miller_rabin(lanes[l], 0);
+}
+
+static int batch_thread(segment_scheduler *sched, int id, void *arg)
+{
+    const batch_task *w = (const batch_task *)arg;
+    uint8_t *bits = w->n_dense > 0 ? (uint8_t *)malloc(PRIME_BATCH_WINDOW / WHEEL_SPAN) : NULL;
+    uint64_t task;
+    bool contiguous;
+    while (scheduler_next(sched, id, &task, &contiguous))
+    {
+        if (task < w->n_dense)
+            batch_window(w, task, bits);
+        else
+            batch_chunk(w, task - w->n_dense);
+    }
+    free(bits);
+    return 0;
+}
+
+int prime_test_batch(const uint64_t *numbers, size_t n, bool *results, int n_threads)
+{
+    if (n == 0)
+        return 0;
+    if (n_threads <= 0)
+        n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const size_t n_windows = (PRIME_BATCH_SIEVE_LIMIT + PRIME_BATCH_WINDOW - 1) / PRIME_BATCH_WINDOW;
+    size_t *counts = (size_t *)calloc(n_windows, sizeof(size_t));
+    bool *dense = (bool *)calloc(n_windows, sizeof(bool));
+    if (counts == NULL || dense == NULL)
+    {
+        free(counts);
+        free(dense);
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        if (numbers[i] < PRIME_BATCH_SIEVE_LIMIT)
+            counts[numbers[i] / PRIME_BATCH_WINDOW]++;
+    }
+
+    // counting sort of the numbers of the dense windows by window
+    size_t n_dense = 0, n_sieved = 0;
+    uint64_t highest = 0;
+    for (size_t k = 0; k < n_windows; k++)
+    {
+        dense[k] = counts[k] >= PRIME_BATCH_DENSE;
+        if (dense[k])
+        {
+            n_dense++;
+            n_sieved += counts[k];
+            highest = (k + 1) * PRIME_BATCH_WINDOW - 1;
+        }
+    }
+    size_t *order = (size_t *)malloc((n_sieved + 1) * sizeof(size_t));
+    size_t *start = (size_t *)malloc((n_dense + 1) * sizeof(size_t));
+    uint64_t *window = (uint64_t *)malloc((n_dense + 1) * sizeof(uint64_t));
+    base_primes bp = {0};
+    uint64_t n_tasks = n_dense + (n + PRIME_BATCH_CHUNK - 1) / PRIME_BATCH_CHUNK;
+    int ret = -1;
+    if (order == NULL || start == NULL || window == NULL)
+        goto done;
+    if (n_dense > 0 && base_primes_init(&bp, isqrt(highest)) != 0)
+        goto done;
+    // counts[k] becomes the next free entry of window k in order
+    size_t next = 0;
+    for (size_t k = 0, d = 0; k < n_windows; k++)
+    {
+        if (!dense[k])
+            continue;
+        start[d] = next;
+        window[d++] = k;
+        size_t count = counts[k];
+        counts[k] = next;
+        next += count;
+    }
+    start[n_dense] = next;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (numbers[i] < PRIME_BATCH_SIEVE_LIMIT && dense[numbers[i] / PRIME_BATCH_WINDOW])
+            order[counts[numbers[i] / PRIME_BATCH_WINDOW]++] = i;
+    }
+
+    batch_task task = {.numbers = numbers, .n = n, .results = results, .bp = &bp, .dense = dense,
+                       .order = order, .start = start, .window = window, .n_dense = n_dense};
+    ret = scheduler_run(n_threads, n_tasks, batch_thread, &task);
+
+done:
+    base_primes_free(&bp);
+    free(window);
+    free(start);
+    free(order);
+    free(dense);
+    free(counts);
+    return ret;
+}
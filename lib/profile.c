@@ -0,0 +1,247 @@
+#include "profile.h"
+
+bool profile_enabled(void)
+{
+#ifdef SIEVE_PROFILE
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef SIEVE_PROFILE
+
+#include "timer.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define PROFILE_COUNTERS 5
+/** Deepest nesting of phases, deeper phases are accounted to the outer one */
+#define PROFILE_MAX_DEPTH 16
+
+typedef struct
+{
+    uint64_t calls;
+    double seconds;
+    uint64_t counters[PROFILE_COUNTERS];
+} profile_totals;
+
+typedef struct profile_thread
+{
+    int id;
+    int fds[PROFILE_COUNTERS];    // -1 when the kernel refused the counter or the thread is gone
+    int slots[PROFILE_COUNTERS];  // position of the counter in the group read
+    bool available[PROFILE_COUNTERS];
+    int leader;                   // group leader fd, -1 without any counter
+    double mark;                  // time of the last phase change
+    uint64_t mark_counters[PROFILE_COUNTERS];
+    profile_phase stack[PROFILE_MAX_DEPTH];
+    int depth;
+    profile_totals totals[PROFILE_PHASE_COUNT];
+    struct profile_thread *next;
+} profile_thread;
+
+static const char *phase_names[PROFILE_PHASE_COUNT] = {
+    [PROFILE_BASE_PRIMES] = "base_primes",
+    [PROFILE_CROSS_OFF] = "cross_off",
+    [PROFILE_COUNT] = "count",
+    [PROFILE_COMMUNICATION] = "communication",
+    [PROFILE_OUTPUT] = "output",
+};
+
+static const char *counter_names[PROFILE_COUNTERS] = {"cycles", "instructions", "llc_misses", "dtlb_misses",
+                                                       "branch_misses"};
+
+static const struct
+{
+    uint32_t type;
+    uint64_t config;
+} counter_events[PROFILE_COUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+// threads are kept after they exit so that the report still has their figures
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static profile_thread *registry = NULL;
+static profile_thread **registry_tail = &registry;
+static int n_registered = 0;
+static pthread_key_t thread_key;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+
+static void thread_exit(void *data)
+{
+    profile_thread *t = (profile_thread *)data;
+    for (int c = 0; c < PROFILE_COUNTERS; c++)
+    {
+        if (t->fds[c] >= 0)
+            close(t->fds[c]);
+        t->fds[c] = -1;
+    }
+    t->leader = -1;
+}
+
+static void create_key(void)
+{
+    pthread_key_create(&thread_key, thread_exit);
+}
+
+static int perf_open(int c, int group)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counter_events[c].type;
+    attr.config = counter_events[c].config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    // this thread on any cpu
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static void read_counters(const profile_thread *t, uint64_t *values)
+{
+    uint64_t group[1 + PROFILE_COUNTERS];
+    bool ok = t->leader >= 0 && read(t->leader, group, sizeof(group)) > 0;
+    for (int c = 0; c < PROFILE_COUNTERS; c++)
+        values[c] = ok && t->fds[c] >= 0 ? group[1 + t->slots[c]] : 0;
+}
+
+static profile_thread *current_thread(void)
+{
+    pthread_once(&key_once, create_key);
+    profile_thread *t = (profile_thread *)pthread_getspecific(thread_key);
+    if (t != NULL)
+        return t;
+    t = (profile_thread *)calloc(1, sizeof(profile_thread));
+    if (t == NULL)
+        return NULL;
+    t->leader = -1;
+    int n_open = 0;
+    for (int c = 0; c < PROFILE_COUNTERS; c++)
+    {
+        t->fds[c] = perf_open(c, t->leader);
+        t->available[c] = t->fds[c] >= 0;
+        if (t->fds[c] < 0)
+            continue;
+        t->slots[c] = n_open++;
+        if (t->leader < 0)
+            t->leader = t->fds[c];
+    }
+    double now;
+    GET_TIME(now);
+    t->mark = now;
+    read_counters(t, t->mark_counters);
+    pthread_mutex_lock(&registry_lock);
+    t->id = n_registered++;
+    *registry_tail = t;
+    registry_tail = &t->next;
+    pthread_mutex_unlock(&registry_lock);
+    pthread_setspecific(thread_key, t);
+    return t;
+}
+
+/**
+ * Charge the time and the counters since the last change to the innermost phase
+ */
+static void advance(profile_thread *t)
+{
+    double now;
+    uint64_t counters[PROFILE_COUNTERS];
+    GET_TIME(now);
+    read_counters(t, counters);
+    if (t->depth > 0)
+    {
+        profile_totals *totals = &t->totals[t->stack[t->depth - 1]];
+        totals->seconds += now - t->mark;
+        for (int c = 0; c < PROFILE_COUNTERS; c++)
+            totals->counters[c] += counters[c] - t->mark_counters[c];
+    }
+    t->mark = now;
+    memcpy(t->mark_counters, counters, sizeof(counters));
+}
+
+void profile_begin(profile_phase phase)
+{
+    profile_thread *t = current_thread();
+    if (t == NULL)
+        return;
+    advance(t);
+    if (t->depth < PROFILE_MAX_DEPTH)
+        t->stack[t->depth++] = phase;
+    t->totals[phase].calls++;
+}
+
+void profile_end(profile_phase phase)
+{
+    profile_thread *t = current_thread();
+    if (t == NULL)
+        return;
+    advance(t);
+    if (t->depth > 0 && t->stack[t->depth - 1] == phase)
+        t->depth--;
+}
+
+static void print_phases(FILE *out, const profile_totals *totals, const bool *available, const char *indent)
+{
+    bool first = true;
+    fprintf(out, "{");
+    for (int p = 0; p < PROFILE_PHASE_COUNT; p++)
+    {
+        if (totals[p].calls == 0)
+            continue;
+        fprintf(out, "%s\n%s  \"%s\": {\"calls\": %lu, \"seconds\": %.9f", first ? "" : ",", indent, phase_names[p],
+                totals[p].calls, totals[p].seconds);
+        for (int c = 0; c < PROFILE_COUNTERS; c++)
+        {
+            if (available[c])
+                fprintf(out, ", \"%s\": %lu", counter_names[c], totals[p].counters[c]);
+            else
+                fprintf(out, ", \"%s\": null", counter_names[c]);
+        }
+        fprintf(out, "}");
+        first = false;
+    }
+    fprintf(out, "\n%s}", indent);
+}
+
+void profile_report(FILE *out, int rank)
+{
+    profile_totals total[PROFILE_PHASE_COUNT];
+    bool available[PROFILE_COUNTERS] = {false};
+    memset(total, 0, sizeof(total));
+    pthread_mutex_lock(&registry_lock);
+    fprintf(out, "{\n  \"rank\": %d,\n  \"threads\": [", rank);
+    for (profile_thread *t = registry; t != NULL; t = t->next)
+    {
+        fprintf(out, "%s\n    {\"thread\": %d, \"phases\": ", t == registry ? "" : ",", t->id);
+        print_phases(out, t->totals, t->available, "    ");
+        fprintf(out, "}");
+        for (int p = 0; p < PROFILE_PHASE_COUNT; p++)
+        {
+            total[p].calls += t->totals[p].calls;
+            total[p].seconds += t->totals[p].seconds;
+            for (int c = 0; c < PROFILE_COUNTERS; c++)
+                total[p].counters[c] += t->totals[p].counters[c];
+        }
+        for (int c = 0; c < PROFILE_COUNTERS; c++)
+            available[c] |= t->available[c];
+    }
+    pthread_mutex_unlock(&registry_lock);
+    fprintf(out, "\n  ],\n  \"total\": ");
+    print_phases(out, total, available, "  ");
+    fprintf(out, "\n}\n");
+}
+
+#endif
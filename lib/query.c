@@ -0,0 +1,351 @@
+#include "query.h"
+#include "backend.h"
+#include "cache.h"
+#include "lmo.h"
+#include "primality.h"
+#include "segment.h"
+#include "wheel.h"
+#include "timer.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+/** Below this n the n-th prime is searched from 0 instead of R^-1(n) */
+#define QUERY_SMALL_N 1000
+
+/**
+ * Sieve of the n-th prime correction windows
+ */
+typedef struct
+{
+    base_primes bp;
+    uint64_t bp_limit; // bp holds every prime <= bp_limit
+    uint8_t *bits;
+} query_window;
+
+/**
+ * Logarithmic integral, Ramanujan's series
+ */
+static long double li(long double x)
+{
+    const long double euler_gamma = 0.577215664901532860606512090082402431L;
+    long double l = logl(x);
+    long double sum = 0;
+    long double term = 1;  // l^n / (n! 2^(n - 1))
+    long double inner = 0; // sum of 1 / (2k + 1) for k <= (n - 1) / 2
+    for (int n = 1; n < 1000; n++)
+    {
+        term *= n == 1 ? l : l / (2 * n);
+        if (n & 1)
+            inner += 1.0L / n;
+        long double t = term * inner;
+        sum += n & 1 ? t : -t;
+        if (t < 1e-20L * fabsl(sum))
+            break;
+    }
+    return euler_gamma + logl(l) + sqrtl(x) * sum;
+}
+
+static int mobius(int k)
+{
+    int mu = 1;
+    for (int p = 2; p * p <= k; p++)
+    {
+        if (k % p == 0)
+        {
+            k /= p;
+            if (k % p == 0)
+                return 0;
+            mu = -mu;
+        }
+    }
+    return k > 1 ? -mu : mu;
+}
+
+/**
+ * Riemann's R(x) = sum mu(k) / k li(x^(1/k))
+ */
+static long double riemann_r(long double x)
+{
+    long double sum = 0;
+    for (int k = 1; k < 64; k++)
+    {
+        long double root = powl(x, 1.0L / k);
+        if (root < 2)
+            break;
+        int mu = mobius(k);
+        if (mu != 0)
+            sum += mu * li(root) / k;
+    }
+    return sum;
+}
+
+/**
+ * R^-1(n) by Newton's method, R'(x) ~ 1 / ln(x)
+ */
+static uint64_t nth_prime_estimate(uint64_t n)
+{
+    if (n < QUERY_SMALL_N)
+        return 0;
+    long double t = (long double)n * logl((long double)n);
+    for (int i = 0; i < 100; i++)
+    {
+        long double dt = (riemann_r(t) - n) * logl(t);
+        t -= dt;
+        if (fabsl(dt) < 0.5L)
+            break;
+    }
+    if (t >= (long double)UINT64_MAX)
+        return UINT64_MAX;
+    return t < 0 ? 0 : (uint64_t)t;
+}
+
+/**
+ * pi(x) from the cache when it covers x, from LMO otherwise
+ */
+static int prime_pi(uint64_t x, int n_threads, const char *cache_path, uint64_t *pi)
+{
+    prime_cache cache;
+    if (cache_path != NULL && prime_cache_open(&cache, cache_path) == 0)
+    {
+        bool covered = prime_cache_limit(&cache) >= x;
+        if (covered)
+            *pi = prime_cache_pi(&cache, x);
+        prime_cache_close(&cache);
+        if (covered)
+            return 0;
+    }
+    return lmo_pi(x, n_threads, pi);
+}
+
+/**
+ * Numbers to sieve to find about need primes near e^log_x
+ */
+static uint64_t window_width(uint64_t need, double log_x)
+{
+    double width = need * log_x * 1.125 + QUERY_NEAR_BYTES * WHEEL_SPAN;
+    // one byte is left for a window that does not start on a byte boundary
+    double max_width = (double)(QUERY_WINDOW_BYTES - 1) * WHEEL_SPAN;
+    return width < max_width ? (uint64_t)width : (uint64_t)max_width;
+}
+
+/**
+ * Sieve [low, high] into w->bits, growing the base primes when needed
+ */
+static int window_sieve(query_window *w, uint64_t low, uint64_t high, uint64_t *count)
+{
+    uint64_t root = isqrt(high);
+    if (root > w->bp_limit)
+    {
+        // the next windows are close: leave some room before growing again
+        uint64_t limit = root + root / 16 + 1;
+        if (limit > UINT32_MAX)
+            limit = UINT32_MAX;
+        base_primes_free(&w->bp);
+        if (base_primes_init(&w->bp, limit) != 0)
+            return -1;
+        w->bp_limit = limit;
+    }
+    if (segmented_sieve(w->bits, low, high, &w->bp, 0, NULL) != 0)
+        return -1;
+    *count = wheel_count(w->bits, low / WHEEL_SPAN, low, high);
+    return 0;
+}
+
+/**
+ * The k-th prime of a sieved window [low, high], k >= 1
+ */
+static uint64_t window_kth(const uint8_t *bits, uint64_t low, uint64_t high, uint64_t k)
+{
+    uint64_t first_byte = low / WHEEL_SPAN;
+    uint64_t p = low;
+    if (!wheel_is_prime(bits, first_byte, p))
+        p = wheel_next_prime(bits, first_byte, high, p);
+    while (--k > 0)
+        p = wheel_next_prime(bits, first_byte, high, p);
+    return p;
+}
+
+int query_nth_prime(uint64_t n, int n_threads, const char *cache_path, uint64_t *p)
+{
+    *p = 0;
+    if (n == 0)
+        return 0;
+    uint64_t x = nth_prime_estimate(n);
+    uint64_t pi = 0;
+    if (x > 0 && prime_pi(x, n_threads, cache_path, &pi) != 0)
+        return -1;
+    query_window w = {.bp = {NULL, 0}, .bp_limit = 0, .bits = (uint8_t *)malloc(QUERY_WINDOW_BYTES)};
+    if (w.bits == NULL)
+        return -1;
+    double log_x = log(x > 2 ? (double)x : 2.0);
+    int ret = 0;
+    if (pi >= n)
+    {
+        // p_n <= x: the (pi - n + 1)-th prime going down from x
+        uint64_t need = pi - n + 1;
+        uint64_t high = x;
+        while (ret == 0 && *p == 0)
+        {
+            uint64_t width = window_width(need, log_x);
+            uint64_t low = high < width ? 0 : high - width + 1;
+            uint64_t count;
+            ret = window_sieve(&w, low, high, &count);
+            if (ret == 0 && count >= need)
+                *p = window_kth(w.bits, low, high, count - need + 1);
+            need -= count;
+            high = low - 1; // low > 0 while primes are missing: [0, x] holds pi >= need of them
+        }
+    }
+    else if (x < UINT64_MAX)
+    {
+        // p_n > x: the (n - pi)-th prime going up from x + 1
+        uint64_t need = n - pi;
+        uint64_t low = x + 1;
+        while (ret == 0 && *p == 0)
+        {
+            uint64_t width = window_width(need, log_x);
+            uint64_t high = UINT64_MAX - low < width - 1 ? UINT64_MAX : low + width - 1;
+            uint64_t count;
+            ret = window_sieve(&w, low, high, &count);
+            if (ret == 0 && count >= need)
+                *p = window_kth(w.bits, low, high, need);
+            else if (high == UINT64_MAX) // p_n does not fit in 64 bits
+                break;
+            need -= count;
+            low = high + 1;
+        }
+    }
+    base_primes_free(&w.bp);
+    free(w.bits);
+    return ret;
+}
+
+/**
+ * Whether a number left by the presieve of a window up to high is prime
+ */
+static bool near_is_prime(uint64_t n, uint64_t high)
+{
+    // every composite <= high has a factor below the presieve limit
+    if (high < (uint64_t)QUERY_PRESIEVE_LIMIT * QUERY_PRESIEVE_LIMIT)
+        return true;
+    return prime_test(n);
+}
+
+int query_next_prime(uint64_t x, uint64_t *p)
+{
+    static const uint64_t small[] = {2, 3, 5, 7};
+    *p = 0;
+    if (x < 7)
+    {
+        for (int i = 0; *p == 0; i++)
+        {
+            if (small[i] > x)
+                *p = small[i];
+        }
+        return 0;
+    }
+    base_primes bp;
+    if (base_primes_init(&bp, QUERY_PRESIEVE_LIMIT) != 0)
+        return -1;
+    uint8_t bits[QUERY_NEAR_BYTES + 1];
+    // low wraps around to 0 after the last window
+    for (uint64_t low = x + 1; low != 0 && *p == 0;)
+    {
+        uint64_t high = UINT64_MAX - low < QUERY_NEAR_BYTES * WHEEL_SPAN - 1 ? UINT64_MAX
+                                                                               : low + QUERY_NEAR_BYTES * WHEEL_SPAN - 1;
+        if (segmented_sieve(bits, low, high, &bp, 0, NULL) != 0)
+        {
+            base_primes_free(&bp);
+            return -1;
+        }
+        uint64_t q = low - 1;
+        while ((q = wheel_next_prime(bits, low / WHEEL_SPAN, high, q)) != 0 && !near_is_prime(q, high))
+            ;
+        *p = q;
+        low = high + 1;
+    }
+    base_primes_free(&bp);
+    return 0;
+}
+
+/**
+ * Largest number of a presieved window [low, high] that is prime, 0 if none
+ */
+static uint64_t near_prev(const uint8_t *bits, uint64_t low, uint64_t high)
+{
+    uint64_t first_byte = low / WHEEL_SPAN;
+    for (uint64_t byte = high / WHEEL_SPAN + 1; byte-- > first_byte;)
+    {
+        // the bits out of [low, high] are clear, no residue past 2^64 - 1 is computed
+        uint8_t word = bits[byte - first_byte];
+        while (word != 0)
+        {
+            int b = 31 - __builtin_clz(word);
+            uint64_t n = byte * WHEEL_SPAN + wheel_residues[b];
+            if (near_is_prime(n, high))
+                return n;
+            word &= ~(1u << b);
+        }
+    }
+    return 0;
+}
+
+int query_prev_prime(uint64_t x, uint64_t *p)
+{
+    static const uint64_t small[] = {5, 3, 2};
+    *p = 0;
+    if (x <= 7)
+    {
+        for (int i = 0; i < 3 && *p == 0; i++)
+        {
+            if (small[i] < x)
+                *p = small[i];
+        }
+        return 0;
+    }
+    base_primes bp;
+    if (base_primes_init(&bp, QUERY_PRESIEVE_LIMIT) != 0)
+        return -1;
+    uint8_t bits[QUERY_NEAR_BYTES + 1];
+    // the wheel starts at 7, 5 is the answer below it
+    for (uint64_t high = x - 1; *p == 0;)
+    {
+        uint64_t low = high - 7 < QUERY_NEAR_BYTES * WHEEL_SPAN ? 7 : high - QUERY_NEAR_BYTES * WHEEL_SPAN + 1;
+        if (segmented_sieve(bits, low, high, &bp, 0, NULL) != 0)
+        {
+            base_primes_free(&bp);
+            return -1;
+        }
+        *p = near_prev(bits, low, high);
+        if (*p == 0 && low == 7)
+            *p = 5;
+        high = low - 1;
+    }
+    base_primes_free(&bp);
+    return 0;
+}
+
+int query_run(const sieve_config *cfg, sieve_result *res)
+{
+    double start, end;
+    GET_TIME(start);
+    int ret = -1;
+    switch (cfg->query)
+    {
+    case SIEVE_QUERY_NTH:
+        ret = query_nth_prime(cfg->max, backend_threads(cfg), cfg->cache_path, &res->prime);
+        break;
+    case SIEVE_QUERY_NEXT:
+        ret = query_next_prime(cfg->max, &res->prime);
+        break;
+    case SIEVE_QUERY_PREV:
+        ret = query_prev_prime(cfg->max, &res->prime);
+        break;
+    default:
+        break;
+    }
+    GET_TIME(end);
+    res->elapsed = end - start;
+    return ret;
+}
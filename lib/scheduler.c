@@ -0,0 +1,149 @@
+#include "scheduler.h"
+
+#include <stdlib.h>
+
+int scheduler_init(segment_scheduler *sched, int n_workers, uint64_t n_tasks)
+{
+    sched->n_workers = n_workers;
+    sched->deques = (task_deque *)calloc(n_workers, sizeof(task_deque));
+    if (sched->deques == NULL)
+        return -1;
+    for (int id = 0; id < n_workers; id++)
+    {
+        pthread_mutex_init(&sched->deques[id].lock, NULL);
+        sched->deques[id].head = (uint64_t)id * n_tasks / n_workers;
+        sched->deques[id].tail = (uint64_t)(id + 1) * n_tasks / n_workers;
+    }
+    return 0;
+}
+
+static bool pop_front(task_deque *dq, uint64_t *task)
+{
+    bool found = false;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->head < dq->tail)
+    {
+        *task = dq->head++;
+        found = true;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+/**
+ * Move the back half of the busiest deque into the (empty) deque of id
+ */
+static bool steal(segment_scheduler *sched, int id)
+{
+    while (true)
+    {
+        int victim = -1;
+        uint64_t most = 0;
+        for (int k = 1; k < sched->n_workers; k++)
+        {
+            int v = (id + k) % sched->n_workers;
+            pthread_mutex_lock(&sched->deques[v].lock);
+            uint64_t left = sched->deques[v].tail - sched->deques[v].head;
+            pthread_mutex_unlock(&sched->deques[v].lock);
+            if (left > most)
+            {
+                most = left;
+                victim = v;
+            }
+        }
+        if (victim < 0)
+            return false;
+
+        task_deque *dq = &sched->deques[victim];
+        uint64_t head = 0, tail = 0;
+        pthread_mutex_lock(&dq->lock);
+        if (dq->head < dq->tail)
+        {
+            tail = dq->tail;
+            head = tail - (dq->tail - dq->head + 1) / 2;
+            dq->tail = head;
+        }
+        pthread_mutex_unlock(&dq->lock);
+        if (head == tail)
+            continue; // the victim drained its range meanwhile, look again
+
+        task_deque *own = &sched->deques[id];
+        pthread_mutex_lock(&own->lock);
+        own->head = head;
+        own->tail = tail;
+        pthread_mutex_unlock(&own->lock);
+        return true;
+    }
+}
+
+bool scheduler_next(segment_scheduler *sched, int id, uint64_t *task, bool *contiguous)
+{
+    *contiguous = true;
+    if (pop_front(&sched->deques[id], task))
+        return true;
+    *contiguous = false;
+    while (steal(sched, id))
+    {
+        if (pop_front(&sched->deques[id], task))
+            return true;
+    }
+    return false;
+}
+
+void scheduler_free(segment_scheduler *sched)
+{
+    for (int id = 0; id < sched->n_workers; id++)
+        pthread_mutex_destroy(&sched->deques[id].lock);
+    free(sched->deques);
+    sched->deques = NULL;
+}
+
+typedef struct
+{
+    segment_scheduler *sched;
+    scheduler_fn fn;
+    void *arg;
+    int id;
+    int status;
+} run_worker;
+
+static void *run_thread(void *arg)
+{
+    run_worker *w = (run_worker *)arg;
+    w->status = w->fn(w->sched, w->id, w->arg);
+    return NULL;
+}
+
+int scheduler_run(int n_workers, uint64_t n_tasks, scheduler_fn fn, void *arg)
+{
+    pthread_t *threads = (pthread_t *)malloc(n_workers * sizeof(pthread_t));
+    run_worker *workers = (run_worker *)malloc(n_workers * sizeof(run_worker));
+    segment_scheduler sched;
+    if (threads == NULL || workers == NULL || scheduler_init(&sched, n_workers, n_tasks) != 0)
+    {
+        free(threads);
+        free(workers);
+        return -1;
+    }
+    for (int id = 0; id < n_workers; id++)
+        workers[id] = (run_worker){.sched = &sched, .fn = fn, .arg = arg, .id = id};
+    int created = 1;
+    for (; created < n_workers; created++)
+    {
+        if (pthread_create(&threads[created], NULL, run_thread, &workers[created]) != 0)
+            break;
+    }
+    // the tasks of a worker whose thread could not start are stolen by the others
+    run_thread(&workers[0]);
+    int ret = workers[0].status;
+    for (int id = 1; id < created; id++)
+    {
+        pthread_join(threads[id], NULL);
+        if (workers[id].status != 0)
+            ret = -1;
+    }
+    scheduler_free(&sched);
+    free(workers);
+    free(threads);
+    return ret;
+}
@@ -0,0 +1,433 @@
+#include "segment.h"
+#include "wheel.h"
+#include "popcount.h"
+#include "profile.h"
+#include "presieve_pattern.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+/** Longer spans do not fit in a bucket entry: every base prime then goes through next[] */
+#define BUCKET_MAX_SPAN (UINT64_C(1) << 26)
+/** Most buckets, each holding a partial block: short segments get longer spans instead of more buckets */
+#define BUCKET_MAX_COUNT 8192
+
+/**
+ * Next multiple of a large base prime
+ */
+typedef struct
+{
+    uint32_t q;   // p / 30
+    uint32_t pos; // byte offset in the span << 6 | wheel index of p << 3 | wheel index of the multiplier
+} bucket_entry;
+
+struct sieve_bucket
+{
+    struct sieve_bucket *next;
+    uint32_t size;
+    bucket_entry entries[SIEVE_BUCKET_ENTRIES];
+};
+
+uint64_t isqrt(uint64_t n)
+{
+    uint64_t r = (uint64_t)sqrtl((long double)n);
+    // sqrtl may be off by one for values close to 2^64
+    while (r > 0 && (r > UINT32_MAX || r * r > n))
+        r--;
+    while (r < UINT32_MAX && (r + 1) * (r + 1) <= n)
+        r++;
+    return r;
+}
+
+static int collect_base_primes(base_primes *bp, uint64_t limit)
+{
+    bp->primes = NULL;
+    bp->count = 0;
+    if (limit > UINT32_MAX)
+        return -1;
+    size_t capacity = 1024;
+    bp->primes = (uint32_t *)malloc(capacity * sizeof(uint32_t));
+    if (bp->primes == NULL)
+        return -1;
+    for (uint32_t p = 2; p <= 5 && p <= limit; p += (p == 2 ? 1 : 2))
+        bp->primes[bp->count++] = p;
+    if (limit < 7)
+        return 0;
+
+    // The primes <= sqrt(limit) sieve the rest, below 49 there is nothing to cross off
+    base_primes small = {NULL, 0};
+    if (limit >= 49 && collect_base_primes(&small, isqrt(limit)) != 0)
+        goto fail;
+    sieve_state st;
+    if (sieve_state_init(&st, &small, limit, SEGMENT_BYTES) != 0)
+        goto fail;
+    sieve_state_seek(&st, 7);
+    uint8_t *segment = (uint8_t *)malloc(SEGMENT_BYTES);
+    if (segment == NULL)
+    {
+        sieve_state_free(&st);
+        goto fail;
+    }
+    uint64_t last = limit / WHEEL_SPAN;
+    for (uint64_t first = 0; first <= last; first += SEGMENT_BYTES)
+    {
+        uint64_t n_bytes = last - first + 1 < SEGMENT_BYTES ? last - first + 1 : SEGMENT_BYTES;
+        sieve_segment(&st, segment, first, n_bytes, 7);
+        for (uint64_t i = 0; i < n_bytes; i++)
+        {
+            for (uint8_t word = segment[i]; word != 0; word &= word - 1)
+            {
+                if (bp->count == capacity)
+                {
+                    capacity *= 2;
+                    uint32_t *primes = (uint32_t *)realloc(bp->primes, capacity * sizeof(uint32_t));
+                    if (primes == NULL)
+                    {
+                        free(segment);
+                        sieve_state_free(&st);
+                        goto fail;
+                    }
+                    bp->primes = primes;
+                }
+                bp->primes[bp->count++] = (uint32_t)((first + i) * WHEEL_SPAN + wheel_residues[__builtin_ctz(word)]);
+            }
+        }
+    }
+    free(segment);
+    sieve_state_free(&st);
+    base_primes_free(&small);
+    return 0;
+
+fail:
+    base_primes_free(&small);
+    base_primes_free(bp);
+    return -1;
+}
+
+int base_primes_init(base_primes *bp, uint64_t limit)
+{
+    PROFILE_BEGIN(PROFILE_BASE_PRIMES);
+    int ret = collect_base_primes(bp, limit);
+    PROFILE_END(PROFILE_BASE_PRIMES);
+    return ret;
+}
+
+void base_primes_free(base_primes *bp)
+{
+    free(bp->primes);
+    bp->primes = NULL;
+    bp->count = 0;
+}
+
+int sieve_state_init(sieve_state *st, const base_primes *bp, uint64_t high, uint64_t segment_bytes)
+{
+    st->bp = bp;
+    st->high = high;
+    st->span = segment_bytes == 0 ? SEGMENT_BYTES : segment_bytes;
+    st->origin = 0;
+    st->bucket_mask = 0;
+    st->buckets = NULL;
+    st->free_blocks = NULL;
+    st->pool = NULL;
+    st->n_blocks = 0;
+    st->used_blocks = 0;
+    st->first = 0;
+    // 2, 3 and 5 are left out by the wheel, the primes up to 19 by the presieve pattern
+    while (st->first < bp->count && bp->primes[st->first] <= PRESIEVE_LARGEST_PRIME)
+        st->first++;
+    st->count = st->first;
+    while (st->count < bp->count && bp->primes[st->count] <= high / bp->primes[st->count])
+        st->count++;
+    // a multiple is never more than 6 (p / 30) + 6 bytes ahead of the previous one
+    uint64_t max_step = st->count > 0 ? bp->primes[st->count - 1] / WHEEL_SPAN * 6 + 6 : 0;
+    // a span may cover several segments: sieve_segment() walks every span overlapping its segment
+    if (st->span < max_step / (BUCKET_MAX_COUNT - 2) + 1)
+        st->span = max_step / (BUCKET_MAX_COUNT - 2) + 1;
+    // from p >= 30 span on, two multiples are at least two spans apart
+    st->large = st->count;
+    if (st->span <= BUCKET_MAX_SPAN)
+    {
+        st->large = st->first;
+        while (st->large < st->count && bp->primes[st->large] / WHEEL_SPAN < st->span)
+            st->large++;
+    }
+    st->next = (uint64_t *)malloc((st->large + 1) * sizeof(uint64_t));
+    st->wi = (uint8_t *)malloc(st->large + 1);
+    if (st->next == NULL || st->wi == NULL)
+    {
+        sieve_state_free(st);
+        return -1;
+    }
+    if (st->large < st->count)
+    {
+        uint64_t n_buckets = 1;
+        while (n_buckets < max_step / st->span + 2)
+            n_buckets *= 2;
+        st->bucket_mask = n_buckets - 1;
+        // at most one partial block per bucket, and one more for the bucket being emptied
+        st->n_blocks = (st->count - st->large) / SIEVE_BUCKET_ENTRIES + n_buckets + 2;
+        st->buckets = (struct sieve_bucket **)calloc(n_buckets, sizeof(struct sieve_bucket *));
+        st->pool = (struct sieve_bucket *)malloc(st->n_blocks * sizeof(struct sieve_bucket));
+        if (st->buckets == NULL || st->pool == NULL)
+        {
+            sieve_state_free(st);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Put the multiple p * m of a large base prime in the bucket of its span
+ */
+static void bucket_push(sieve_state *st, uint64_t byte, uint32_t q, unsigned p_wi, unsigned m_wi)
+{
+    uint64_t offset = byte - st->origin;
+    struct sieve_bucket **head = &st->buckets[(offset / st->span) & st->bucket_mask];
+    struct sieve_bucket *b = *head;
+    if (b == NULL || b->size == SIEVE_BUCKET_ENTRIES)
+    {
+        struct sieve_bucket *fresh = st->free_blocks;
+        if (fresh != NULL)
+            st->free_blocks = fresh->next;
+        else
+            fresh = &st->pool[st->used_blocks++];
+        fresh->next = b;
+        fresh->size = 0;
+        *head = b = fresh;
+    }
+    b->entries[b->size++] = (bucket_entry){q, (uint32_t)(offset % st->span) << 6 | p_wi << 3 | m_wi};
+}
+
+void sieve_state_seek(sieve_state *st, uint64_t low)
+{
+    st->origin = low / WHEEL_SPAN;
+    if (st->pool != NULL)
+    {
+        memset(st->buckets, 0, (st->bucket_mask + 1) * sizeof(struct sieve_bucket *));
+        st->free_blocks = NULL;
+        st->used_blocks = 0;
+    }
+    // a bucket only holds multiples close to the segments sieved: the squares far ahead wait in pending
+    st->pending = st->large;
+    while (st->pending < st->count && (uint64_t)st->bp->primes[st->pending] * st->bp->primes[st->pending] < low)
+        st->pending++;
+    for (size_t k = st->first; k < st->pending; k++)
+    {
+        uint64_t p = st->bp->primes[k];
+        uint64_t start = low > p * p ? low : p * p;
+        // smallest multiplier m coprime to 30 such that p * m >= start
+        uint64_t m = start / p + (start % p != 0);
+        while (wheel_index[m % WHEEL_SPAN] == 0xff)
+            m++;
+        if (m > st->high / p)
+        {
+            if (k < st->large)
+            {
+                st->next[k] = UINT64_MAX; // no multiple left in range
+                st->wi[k] = 0;
+            }
+            continue;
+        }
+        if (k < st->large)
+        {
+            st->next[k] = p * m / WHEEL_SPAN;
+            st->wi[k] = wheel_index[m % WHEEL_SPAN];
+        }
+        else
+        {
+            bucket_push(st, p * m / WHEEL_SPAN, (uint32_t)(p / WHEEL_SPAN), wheel_index[p % WHEEL_SPAN],
+                        wheel_index[m % WHEEL_SPAN]);
+        }
+    }
+}
+
+/**
+ * Cross off the multiples waiting in the bucket of a span, up to the end of the segment
+ *
+ * Each large prime crosses off one multiple at most and moves on to the bucket of
+ * its next one; the multiples past the segment wait in the bucket for the next call.
+ */
+static void bucket_sieve(sieve_state *st, uint8_t *segment, uint64_t first_byte, uint64_t end, uint64_t span)
+{
+    uint64_t last = st->high / WHEEL_SPAN;
+    uint64_t base = st->origin + span * st->span;
+    struct sieve_bucket **head = &st->buckets[span & st->bucket_mask];
+    struct sieve_bucket *b = *head;
+    *head = NULL;
+    while (b != NULL)
+    {
+        for (uint32_t e = 0; e < b->size; e++)
+        {
+            bucket_entry entry = b->entries[e];
+            uint64_t i = base + (entry.pos >> 6);
+            unsigned p_wi = (entry.pos >> 3) & 7;
+            unsigned j = entry.pos & 7;
+            if (i < end)
+            {
+                const wheel_step *step = &wheel_steps[p_wi][j];
+                segment[i - first_byte] &= ~step->mask; // mark
+                i += (uint64_t)entry.q * wheel_deltas[j] + step->carry;
+                j = (j + 1) & 7;
+                if (i > last)
+                    continue; // no multiple left in range
+            }
+            bucket_push(st, i, entry.q, p_wi, j);
+        }
+        struct sieve_bucket *done = b;
+        b = b->next;
+        done->next = st->free_blocks;
+        st->free_blocks = done;
+    }
+}
+
+/**
+ * Tile the presieve pattern over the bytes [first_byte, first_byte + n_bytes)
+ */
+static void presieve(uint8_t *segment, uint64_t first_byte, uint64_t n_bytes)
+{
+    uint64_t offset = first_byte % PRESIEVE_BYTES;
+    for (uint64_t done = 0; done < n_bytes;)
+    {
+        uint64_t size = PRESIEVE_BYTES - offset < n_bytes - done ? PRESIEVE_BYTES - offset : n_bytes - done;
+        memcpy(segment + done, presieve_pattern + offset, size);
+        done += size;
+        offset = 0;
+    }
+    if (first_byte == 0)
+        segment[0] |= PRESIEVE_PRIMES_MASK;
+}
+
+uint64_t sieve_segment(sieve_state *st, uint8_t *segment, uint64_t first_byte, uint64_t n_bytes, uint64_t low)
+{
+    PROFILE_BEGIN(PROFILE_CROSS_OFF);
+    presieve(segment, first_byte, n_bytes);
+    uint64_t end = first_byte + n_bytes;
+    for (size_t k = st->first; k < st->large; k++)
+    {
+        uint64_t i = st->next[k];
+        if (i >= end)
+            continue;
+        uint64_t p = st->bp->primes[k];
+        uint64_t q = p / WHEEL_SPAN;
+        const wheel_step *steps = wheel_steps[wheel_index[p % WHEEL_SPAN]];
+        unsigned j = st->wi[k];
+        while (i < end)
+        {
+            segment[i - first_byte] &= ~steps[j].mask; // mark
+            i += q * wheel_deltas[j] + steps[j].carry;
+            j = (j + 1) & 7;
+        }
+        st->next[k] = i;
+        st->wi[k] = j;
+    }
+    if (st->pool != NULL)
+    {
+        // the squares reached by this segment join the buckets
+        for (; st->pending < st->count; st->pending++)
+        {
+            uint64_t p = st->bp->primes[st->pending];
+            if (p * p / WHEEL_SPAN >= end)
+                break;
+            bucket_push(st, p * p / WHEEL_SPAN, (uint32_t)(p / WHEEL_SPAN), wheel_index[p % WHEEL_SPAN],
+                        wheel_index[p % WHEEL_SPAN]);
+        }
+        // every segment starts at or after the last seek, where the first span begins
+        for (uint64_t span = (first_byte - st->origin) / st->span; st->origin + span * st->span < end; span++)
+            bucket_sieve(st, segment, first_byte, end, span);
+    }
+
+    // Clear what is out of [low, high]: 1 is not prime either
+    if (first_byte <= low / WHEEL_SPAN && low / WHEEL_SPAN < end)
+    {
+        uint64_t r = low % WHEEL_SPAN;
+        for (int b = 0; b < 8 && wheel_residues[b] < r; b++)
+            segment[low / WHEEL_SPAN - first_byte] &= ~(1u << b);
+    }
+    if (first_byte == 0)
+        segment[0] &= ~wheel_bit[1];
+    if (first_byte <= st->high / WHEEL_SPAN && st->high / WHEEL_SPAN < end)
+    {
+        uint64_t r = st->high % WHEEL_SPAN;
+        uint64_t last = st->high / WHEEL_SPAN - first_byte;
+        for (int b = 7; b >= 0 && wheel_residues[b] > r; b--)
+            segment[last] &= ~(1u << b);
+        memset(segment + last + 1, 0, n_bytes - last - 1);
+    }
+    PROFILE_END(PROFILE_CROSS_OFF);
+    PROFILE_BEGIN(PROFILE_COUNT);
+    uint64_t count = popcount_bytes(segment, n_bytes);
+    PROFILE_END(PROFILE_COUNT);
+    return count;
+}
+
+void sieve_state_free(sieve_state *st)
+{
+    free(st->next);
+    free(st->wi);
+    free(st->buckets);
+    free(st->pool);
+    st->next = NULL;
+    st->wi = NULL;
+    st->buckets = NULL;
+    st->pool = NULL;
+}
+
+int segmented_sieve(uint8_t *bits, uint64_t low, uint64_t high, const base_primes *bp, uint64_t segment_bytes,
+                    uint64_t *count)
+{
+    uint64_t total = 0;
+    if (low <= high)
+    {
+        if (segment_bytes == 0)
+            segment_bytes = SEGMENT_BYTES;
+        sieve_state st;
+        if (sieve_state_init(&st, bp, high, segment_bytes) != 0)
+            return -1;
+        sieve_state_seek(&st, low);
+        uint64_t first = low / WHEEL_SPAN;
+        uint64_t last = high / WHEEL_SPAN;
+        for (uint64_t byte = first; byte <= last; byte += segment_bytes)
+        {
+            uint64_t n_bytes = last - byte + 1 < segment_bytes ? last - byte + 1 : segment_bytes;
+            total += sieve_segment(&st, bits + (byte - first), byte, n_bytes, low);
+            if (last - byte < segment_bytes)
+                break;
+        }
+        sieve_state_free(&st);
+    }
+    if (count != NULL)
+        *count = total;
+    return 0;
+}
+
+int segmented_count(uint64_t low, uint64_t high, const base_primes *bp, uint64_t segment_bytes, uint64_t *count)
+{
+    *count = 0;
+    if (low > high)
+        return 0;
+    if (segment_bytes == 0)
+        segment_bytes = SEGMENT_BYTES;
+    sieve_state st;
+    uint8_t *segment = (uint8_t *)malloc(segment_bytes);
+    if (segment == NULL || sieve_state_init(&st, bp, high, segment_bytes) != 0)
+    {
+        free(segment);
+        return -1;
+    }
+    sieve_state_seek(&st, low);
+    uint64_t first = low / WHEEL_SPAN;
+    uint64_t last = high / WHEEL_SPAN;
+    for (uint64_t byte = first; byte <= last; byte += segment_bytes)
+    {
+        uint64_t n_bytes = last - byte + 1 < segment_bytes ? last - byte + 1 : segment_bytes;
+        *count += sieve_segment(&st, segment, byte, n_bytes, low);
+        if (last - byte < segment_bytes)
+            break;
+    }
+    sieve_state_free(&st);
+    free(segment);
+    return 0;
+}
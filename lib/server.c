@@ -0,0 +1,971 @@
+#define _GNU_SOURCE // accept4()
+#include "server.h"
+#include "segment.h"
+#include "wheel.h"
+#include "primality.h"
+#include "lmo.h"
+#include "alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/** Numbers per cached block */
+#define BLOCK_NUMBERS ((uint64_t)SERVER_BLOCK_BYTES * WHEEL_SPAN)
+/** Largest request a connection may send */
+#define REQUEST_MAX_BYTES (sizeof(server_header) + (size_t)SERVER_MAX_QUERIES * sizeof(server_query))
+#define READ_CHUNK 65536
+#define LISTEN_BACKLOG 128
+#define EPOLL_EVENTS 64
+
+typedef struct
+{
+    uint64_t block; // block index, numbers [block * BLOCK_NUMBERS, (block + 1) * BLOCK_NUMBERS)
+    uint64_t used;  // tick of the last access, the smallest one is evicted
+    bool valid;
+} block_slot;
+
+typedef struct connection
+{
+    int fd; // -1 once closed, the connection is freed when its batch comes back
+    uint8_t *in;
+    size_t in_size;
+    size_t in_capacity;
+    uint8_t *out;
+    size_t out_size;
+    size_t out_sent;
+    bool busy; // a batch of this connection is with the workers
+    bool eof;  // the peer will not send more requests
+    struct connection *prev;
+    struct connection *next;
+} connection;
+
+typedef struct job
+{
+    connection *conn;
+    server_query *queries;
+    uint32_t n_queries;
+    uint8_t *out;
+    size_t out_size;
+    size_t out_capacity;
+    bool failed; // out could not grow
+    struct job *next;
+} job;
+
+typedef struct
+{
+    server_config cfg;
+    base_primes bp; // every prime <= sqrt(cfg.limit)
+
+    pthread_mutex_t cache_lock;
+    block_slot *slots;
+    uint8_t *blocks; // cfg.cache_blocks * SERVER_BLOCK_BYTES
+    uint64_t tick;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    job *todo;      // batches waiting for a worker, oldest first
+    job *todo_tail;
+    job *done;      // answered batches, for the event loop
+    bool stop;
+    atomic_bool cancel; // set at shutdown: the long counts in progress give up
+
+    int epoll_fd;
+    int listen_fd;
+    int wake_fd;   // eventfd written by the workers when a batch is done
+    int signal_fd; // SIGINT and SIGTERM
+    connection *connections;
+    connection *closed; // freed once the current events are handled
+} server;
+
+void server_config_init(server_config *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->socket_path = SERVER_SOCKET_DEFAULT;
+    cfg->limit = SERVER_LIMIT_DEFAULT;
+    cfg->lmo_max = SERVER_LMO_MAX;
+    cfg->cache_blocks = SERVER_CACHE_BLOCKS;
+}
+
+/*
+ * Block cache: a linear scan of the slots under the lock, a few hundred
+ * compares, well below the cost of copying or sieving a block
+ */
+
+static block_slot *cache_find(server *s, uint64_t block)
+{
+    for (uint64_t i = 0; i < s->cfg.cache_blocks; i++)
+    {
+        if (s->slots[i].valid && s->slots[i].block == block)
+        {
+            s->slots[i].used = ++s->tick;
+            return &s->slots[i];
+        }
+    }
+    return NULL;
+}
+
+static const uint8_t *slot_bits(const server *s, const block_slot *slot)
+{
+    return s->blocks + (uint64_t)(slot - s->slots) * SERVER_BLOCK_BYTES;
+}
+
+/**
+ * Whether n is prime according to the cache: 1 or 0, -1 when its block is not cached
+ */
+static int cache_bit(server *s, uint64_t n)
+{
+    uint64_t block = n / BLOCK_NUMBERS;
+    pthread_mutex_lock(&s->cache_lock);
+    block_slot *slot = cache_find(s, block);
+    int bit = slot == NULL ? -1 : wheel_is_prime(slot_bits(s, slot), block * SERVER_BLOCK_BYTES, n);
+    pthread_mutex_unlock(&s->cache_lock);
+    return bit;
+}
+
+/**
+ * Copy a cached block to bits
+ * @return true if it was cached
+ */
+static bool cache_get(server *s, uint64_t block, uint8_t *bits)
+{
+    pthread_mutex_lock(&s->cache_lock);
+    block_slot *slot = cache_find(s, block);
+    if (slot != NULL)
+        memcpy(bits, slot_bits(s, slot), SERVER_BLOCK_BYTES);
+    pthread_mutex_unlock(&s->cache_lock);
+    return slot != NULL;
+}
+
+static void cache_put(server *s, uint64_t block, const uint8_t *bits)
+{
+    pthread_mutex_lock(&s->cache_lock);
+    // another worker may have sieved it meanwhile
+    block_slot *slot = cache_find(s, block);
+    if (slot == NULL)
+    {
+        slot = &s->slots[0];
+        for (uint64_t i = 1; i < s->cfg.cache_blocks && slot->valid; i++)
+        {
+            if (!s->slots[i].valid || s->slots[i].used < slot->used)
+                slot = &s->slots[i];
+        }
+        slot->block = block;
+        slot->used = ++s->tick;
+        slot->valid = true;
+        memcpy(s->blocks + (uint64_t)(slot - s->slots) * SERVER_BLOCK_BYTES, bits, SERVER_BLOCK_BYTES);
+    }
+    pthread_mutex_unlock(&s->cache_lock);
+}
+
+/**
+ * Whether the block holds numbers <= limit: the base primes cover the whole block of the limit
+ */
+static bool block_sievable(const server *s, uint64_t block)
+{
+    return block <= s->cfg.limit / BLOCK_NUMBERS;
+}
+
+/**
+ * Last number of the block of the limit, the largest one the base primes must sieve
+ */
+static uint64_t limit_block_end(uint64_t limit)
+{
+    uint64_t block = limit / BLOCK_NUMBERS;
+    return block >= UINT64_MAX / BLOCK_NUMBERS ? UINT64_MAX : block * BLOCK_NUMBERS + (BLOCK_NUMBERS - 1);
+}
+
+/**
+ * Sieved bytes of a block into bits, from the cache or sieved and then cached
+ * @return 0 on success, -1 if the memory could not be allocated
+ */
+static int block_fetch(server *s, uint64_t block, uint8_t *bits)
+{
+    if (cache_get(s, block, bits))
+        return 0;
+    uint64_t low = block * BLOCK_NUMBERS;
+    sieve_state st;
+    if (sieve_state_init(&st, &s->bp, low + BLOCK_NUMBERS - 1, SERVER_BLOCK_BYTES) != 0)
+        return -1;
+    sieve_state_seek(&st, low);
+    sieve_segment(&st, bits, block * SERVER_BLOCK_BYTES, SERVER_BLOCK_BYTES, low);
+    sieve_state_free(&st);
+    cache_put(s, block, bits);
+    return 0;
+}
+
+/*
+ * Answers
+ */
+
+static void *job_reserve(job *j, size_t size)
+{
+    if (j->failed)
+        return NULL;
+    if (j->out_size + size > j->out_capacity)
+    {
+        size_t capacity = j->out_capacity * 2 > j->out_size + size ? j->out_capacity * 2 : j->out_size + size;
+        uint8_t *out = (uint8_t *)realloc(j->out, capacity);
+        if (out == NULL)
+        {
+            j->failed = true;
+            return NULL;
+        }
+        j->out = out;
+        j->out_capacity = capacity;
+    }
+    void *p = j->out + j->out_size;
+    j->out_size += size;
+    return p;
+}
+
+static void job_value(job *j, uint64_t value)
+{
+    uint64_t *p = (uint64_t *)job_reserve(j, sizeof(value));
+    if (p != NULL)
+        memcpy(p, &value, sizeof(value));
+}
+
+/**
+ * Append a result header, return its offset to fill n_values in once known
+ */
+static size_t job_result(job *j, server_status status)
+{
+    size_t offset = j->out_size;
+    server_result *r = (server_result *)job_reserve(j, sizeof(server_result));
+    if (r != NULL)
+    {
+        memset(r, 0, sizeof(*r));
+        r->status = status;
+    }
+    return offset;
+}
+
+static void job_set_values(job *j, size_t offset, uint64_t n_values)
+{
+    if (!j->failed)
+        memcpy(j->out + offset + offsetof(server_result, n_values), &n_values, sizeof(n_values));
+}
+
+static bool answer_is_prime(server *s, uint64_t n)
+{
+    if (n < 7)
+        return n == 2 || n == 3 || n == 5;
+    int bit = cache_bit(s, n);
+    return bit >= 0 ? bit : prime_test(n);
+}
+
+/**
+ * Smallest prime > n, 0 if there is none below 2^64
+ */
+static uint64_t answer_next_prime(server *s, uint64_t n, uint8_t *bits)
+{
+    if (n == UINT64_MAX)
+        return 0;
+    uint64_t block = (n + 1) / BLOCK_NUMBERS;
+    if (cache_get(s, block, bits))
+    {
+        uint64_t last = block * BLOCK_NUMBERS + (BLOCK_NUMBERS - 1);
+        uint64_t p = wheel_next_prime(bits, block * SERVER_BLOCK_BYTES, last, n);
+        if (p != 0)
+            return p;
+        n = last;
+    }
+    if (n < 7)
+        return n < 2 ? 2 : n < 3 ? 3 : n < 5 ? 5 : 7;
+    for (uint64_t m = n + 1; m > n; m++)
+    {
+        if (wheel_bit[m % WHEEL_SPAN] && prime_test(m))
+            return m;
+    }
+    return 0;
+}
+
+/**
+ * Primes of [lo, hi] sieved segment by segment with a state of their own: a long
+ * range would evict every cached block for numbers nobody asks about again
+ */
+static server_status count_sieved(server *s, uint64_t lo, uint64_t hi, uint8_t *bits, uint64_t *count)
+{
+    sieve_state st;
+    if (sieve_state_init(&st, &s->bp, hi, SERVER_BLOCK_BYTES) != 0)
+        return SERVER_ENOMEM;
+    sieve_state_seek(&st, lo);
+    *count = wheel_small_primes(lo, hi);
+    server_status status = SERVER_OK;
+    uint64_t last = hi / WHEEL_SPAN;
+    for (uint64_t byte = lo / WHEEL_SPAN; byte <= last; byte += SERVER_BLOCK_BYTES)
+    {
+        if (atomic_load_explicit(&s->cancel, memory_order_relaxed))
+        {
+            status = SERVER_ECANCELED;
+            break;
+        }
+        uint64_t n_bytes = last - byte < SERVER_BLOCK_BYTES ? last - byte + 1 : SERVER_BLOCK_BYTES;
+        *count += sieve_segment(&st, bits, byte, n_bytes, lo);
+    }
+    sieve_state_free(&st);
+    return status;
+}
+
+/**
+ * Numbers sieved in about the time of the LMO counts of [lo, hi]
+ */
+static double lmo_cost(uint64_t lo, uint64_t hi)
+{
+    double cost = cbrt((double)hi) * cbrt((double)hi);
+    if (lo > 1)
+        cost += cbrt((double)(lo - 1)) * cbrt((double)(lo - 1));
+    return SERVER_LMO_COST * cost;
+}
+
+static server_status answer_count(server *s, uint64_t lo, uint64_t hi, uint8_t *bits, uint64_t *count)
+{
+    uint64_t first = lo / BLOCK_NUMBERS;
+    uint64_t last = hi / BLOCK_NUMBERS;
+    *count = 0;
+    if (block_sievable(s, last) && last - first < SERVER_SIEVE_BLOCKS)
+    {
+        for (uint64_t block = first; block <= last; block++)
+        {
+            if (block_fetch(s, block, bits) != 0)
+                return SERVER_ENOMEM;
+            uint64_t low = block * BLOCK_NUMBERS;
+            uint64_t high = low + (BLOCK_NUMBERS - 1);
+            *count += wheel_count(bits, block * SERVER_BLOCK_BYTES, lo > low ? lo : low, hi < high ? hi : high);
+        }
+        return SERVER_OK;
+    }
+    // the sieve wins on any range narrower than the LMO cost of its ends
+    if (hi <= s->cfg.limit && (double)(hi - lo) < lmo_cost(lo, hi))
+        return count_sieved(s, lo, hi, bits, count);
+    if (hi > s->cfg.lmo_max)
+        return SERVER_ERANGE;
+    // one thread: the workers already run batches in parallel
+    uint64_t pi_hi, pi_lo = 0;
+    if (lmo_pi_cancellable(hi, 1, &s->cancel, &pi_hi) != 0 ||
+        (lo > 1 && lmo_pi_cancellable(lo - 1, 1, &s->cancel, &pi_lo) != 0))
+        return atomic_load_explicit(&s->cancel, memory_order_relaxed) ? SERVER_ECANCELED : SERVER_ENOMEM;
+    *count = pi_hi - pi_lo;
+    return SERVER_OK;
+}
+
+static void answer_primes(server *s, job *j, uint64_t lo, uint64_t hi, uint8_t *bits)
+{
+    uint64_t last = hi / BLOCK_NUMBERS;
+    if (hi - lo >= SERVER_MAX_LIST || hi > s->cfg.limit)
+    {
+        job_result(j, SERVER_ERANGE);
+        return;
+    }
+    size_t result = job_result(j, SERVER_OK);
+    uint64_t n_values = 0;
+    static const uint64_t small[] = {2, 3, 5}; // not in the wheel
+    for (int i = 0; i < 3; i++)
+    {
+        if (lo <= small[i] && small[i] <= hi)
+        {
+            job_value(j, small[i]);
+            n_values++;
+        }
+    }
+    for (uint64_t block = lo / BLOCK_NUMBERS; block <= last; block++)
+    {
+        if (block_fetch(s, block, bits) != 0)
+        {
+            // drop the values already appended
+            j->out_size = result;
+            job_result(j, SERVER_ENOMEM);
+            return;
+        }
+        uint64_t low = block * BLOCK_NUMBERS;
+        uint64_t first_byte = lo > low ? (lo - low) / WHEEL_SPAN : 0;
+        uint64_t last_byte = hi - low < BLOCK_NUMBERS ? (hi - low) / WHEEL_SPAN : SERVER_BLOCK_BYTES - 1;
+        for (uint64_t byte = first_byte; byte <= last_byte; byte++)
+        {
+            for (uint8_t word = bits[byte]; word != 0; word &= word - 1)
+            {
+                uint64_t n = low + byte * WHEEL_SPAN + wheel_residues[__builtin_ctz(word)];
+                if (lo <= n && n <= hi)
+                {
+                    job_value(j, n);
+                    n_values++;
+                }
+            }
+        }
+    }
+    job_set_values(j, result, n_values);
+}
+
+static void answer_batch(server *s, job *j, uint8_t *bits)
+{
+    server_header *header = (server_header *)job_reserve(j, sizeof(server_header));
+    if (header != NULL)
+    {
+        header->magic = SERVER_MAGIC;
+        header->count = j->n_queries;
+    }
+    for (uint32_t i = 0; i < j->n_queries; i++)
+    {
+        const server_query *q = &j->queries[i];
+        bool range = q->op == SERVER_COUNT || q->op == SERVER_PRIMES;
+        if (range && q->lo > q->hi)
+        {
+            job_result(j, SERVER_EINVAL);
+            continue;
+        }
+        switch (q->op)
+        {
+        case SERVER_IS_PRIME:
+            job_set_values(j, job_result(j, SERVER_OK), 1);
+            job_value(j, answer_is_prime(s, q->lo));
+            break;
+        case SERVER_NEXT_PRIME:
+            job_set_values(j, job_result(j, SERVER_OK), 1);
+            job_value(j, answer_next_prime(s, q->lo, bits));
+            break;
+        case SERVER_COUNT:
+        {
+            uint64_t count;
+            server_status status = answer_count(s, q->lo, q->hi, bits, &count);
+            size_t result = job_result(j, status);
+            if (status == SERVER_OK)
+            {
+                job_set_values(j, result, 1);
+                job_value(j, count);
+            }
+            break;
+        }
+        case SERVER_PRIMES:
+            answer_primes(s, j, q->lo, q->hi, bits);
+            break;
+        default:
+            job_result(j, SERVER_EINVAL);
+        }
+    }
+}
+
+static void *worker(void *arg)
+{
+    server *s = (server *)arg;
+    uint8_t *bits = (uint8_t *)malloc(SERVER_BLOCK_BYTES);
+    pthread_mutex_lock(&s->lock);
+    while (true)
+    {
+        while (s->todo == NULL && !s->stop)
+            pthread_cond_wait(&s->cond, &s->lock);
+        if (s->todo == NULL)
+            break;
+        job *j = s->todo;
+        s->todo = j->next;
+        pthread_mutex_unlock(&s->lock);
+
+        if (bits == NULL)
+            j->failed = true;
+        else
+            answer_batch(s, j, bits);
+
+        pthread_mutex_lock(&s->lock);
+        j->next = s->done;
+        s->done = j;
+        uint64_t one = 1;
+        if (write(s->wake_fd, &one, sizeof(one)) < 0)
+            perror("server: eventfd");
+    }
+    pthread_mutex_unlock(&s->lock);
+    free(bits);
+    return NULL;
+}
+
+/*
+ * Connections, only touched by the event loop
+ */
+
+/**
+ * Move a closed connection to the closed list: later events of the same epoll_wait() may still name it
+ */
+static void conn_release(server *s, connection *c)
+{
+    if (c->prev != NULL)
+        c->prev->next = c->next;
+    else
+        s->connections = c->next;
+    if (c->next != NULL)
+        c->next->prev = c->prev;
+    c->next = s->closed;
+    s->closed = c;
+}
+
+static void free_list(connection *c)
+{
+    while (c != NULL)
+    {
+        connection *next = c->next;
+        if (c->fd >= 0)
+            close(c->fd);
+        free(c->in);
+        free(c->out);
+        free(c);
+        c = next;
+    }
+}
+
+static void conn_close(server *s, connection *c)
+{
+    epoll_ctl(s->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    // a batch still with the workers frees it when it comes back
+    if (!c->busy)
+        conn_release(s, c);
+}
+
+static int conn_watch(server *s, connection *c, uint32_t events)
+{
+    struct epoll_event ev = {.events = events, .data.ptr = c};
+    return epoll_ctl(s->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+/**
+ * Hand the next buffered request to the workers, or wait for more of it
+ */
+static void conn_next(server *s, connection *c)
+{
+    server_header header;
+    if (c->in_size >= sizeof(header))
+    {
+        memcpy(&header, c->in, sizeof(header));
+        if (header.magic != SERVER_MAGIC || header.count > SERVER_MAX_QUERIES)
+        {
+            conn_close(s, c);
+            return;
+        }
+        size_t size = sizeof(header) + (size_t)header.count * sizeof(server_query);
+        if (c->in_size >= size)
+        {
+            job *j = (job *)calloc(1, sizeof(job));
+            server_query *queries = (server_query *)malloc(size - sizeof(header) + 1);
+            if (j == NULL || queries == NULL)
+            {
+                free(j);
+                free(queries);
+                conn_close(s, c);
+                return;
+            }
+            memcpy(queries, c->in + sizeof(header), size - sizeof(header));
+            memmove(c->in, c->in + size, c->in_size - size);
+            c->in_size -= size;
+            j->conn = c;
+            j->queries = queries;
+            j->n_queries = header.count;
+            c->busy = true;
+            // nothing to watch until the answer: further requests wait in the socket
+            conn_watch(s, c, 0);
+            pthread_mutex_lock(&s->lock);
+            if (s->todo == NULL)
+                s->todo = j;
+            else
+                s->todo_tail->next = j;
+            s->todo_tail = j;
+            pthread_cond_signal(&s->cond);
+            pthread_mutex_unlock(&s->lock);
+            return;
+        }
+    }
+    if (c->eof)
+        conn_close(s, c);
+    else
+        conn_watch(s, c, EPOLLIN);
+}
+
+static void conn_read(server *s, connection *c)
+{
+    while (!c->eof)
+    {
+        if (c->in_capacity - c->in_size < READ_CHUNK)
+        {
+            if (c->in_capacity >= REQUEST_MAX_BYTES + READ_CHUNK)
+                break; // more than a request is buffered: parse it first
+            uint8_t *in = (uint8_t *)realloc(c->in, c->in_capacity + READ_CHUNK);
+            if (in == NULL)
+            {
+                conn_close(s, c);
+                return;
+            }
+            c->in = in;
+            c->in_capacity += READ_CHUNK;
+        }
+        ssize_t n = read(c->fd, c->in + c->in_size, c->in_capacity - c->in_size);
+        if (n > 0)
+            c->in_size += n;
+        else if (n == 0)
+            c->eof = true;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+        else if (errno != EINTR)
+        {
+            conn_close(s, c);
+            return;
+        }
+    }
+    conn_next(s, c);
+}
+
+/**
+ * Write what the socket accepts of the response, then move on to the next request
+ */
+static void conn_write(server *s, connection *c)
+{
+    while (c->out_sent < c->out_size)
+    {
+        ssize_t n = send(c->fd, c->out + c->out_sent, c->out_size - c->out_sent, MSG_NOSIGNAL);
+        if (n >= 0)
+            c->out_sent += n;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            conn_watch(s, c, EPOLLOUT);
+            return;
+        }
+        else if (errno != EINTR)
+        {
+            conn_close(s, c);
+            return;
+        }
+    }
+    free(c->out);
+    c->out = NULL;
+    c->out_size = c->out_sent = 0;
+    conn_next(s, c);
+}
+
+static void accept_all(server *s)
+{
+    while (true)
+    {
+        int fd = accept4(s->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+        connection *c = (connection *)calloc(1, sizeof(connection));
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+        if (c == NULL || epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            free(c);
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->next = s->connections;
+        if (s->connections != NULL)
+            s->connections->prev = c;
+        s->connections = c;
+    }
+}
+
+/**
+ * Send the answered batches back
+ */
+static void collect_done(server *s)
+{
+    uint64_t n;
+    if (read(s->wake_fd, &n, sizeof(n)) < 0)
+        return;
+    pthread_mutex_lock(&s->lock);
+    job *done = s->done;
+    s->done = NULL;
+    pthread_mutex_unlock(&s->lock);
+    while (done != NULL)
+    {
+        job *j = done;
+        done = j->next;
+        connection *c = j->conn;
+        c->busy = false;
+        if (c->fd < 0)
+        {
+            conn_release(s, c);
+            free(j->out);
+        }
+        else if (j->failed)
+        {
+            free(j->out);
+            conn_close(s, c);
+        }
+        else
+        {
+            c->out = j->out;
+            c->out_size = j->out_size;
+            c->out_sent = 0;
+            conn_write(s, c);
+        }
+        free(j->queries);
+        free(j);
+    }
+}
+
+static int listen_on(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "server: socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, LISTEN_BACKLOG) != 0)
+    {
+        perror("server: bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int watch_fd(server *s, int fd, void *tag)
+{
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = tag};
+    return epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void event_loop(server *s)
+{
+    struct epoll_event events[EPOLL_EVENTS];
+    while (true)
+    {
+        int n = epoll_wait(s->epoll_fd, events, EPOLL_EVENTS, -1);
+        if (n < 0 && errno != EINTR)
+            return;
+        for (int i = 0; i < n; i++)
+        {
+            void *tag = events[i].data.ptr;
+            if (tag == &s->signal_fd)
+            {
+                // consume it: it would be delivered once the mask is restored
+                struct signalfd_siginfo info;
+                if (read(s->signal_fd, &info, sizeof(info)) < 0)
+                    perror("server: signalfd");
+                return;
+            }
+            if (tag == &s->listen_fd)
+            {
+                accept_all(s);
+                continue;
+            }
+            if (tag == &s->wake_fd)
+            {
+                collect_done(s);
+                continue;
+            }
+            connection *c = (connection *)tag;
+            // closed while handling an earlier event of this batch
+            if (c->fd < 0)
+                continue;
+            if (events[i].events & EPOLLOUT)
+                conn_write(s, c);
+            else if (events[i].events & EPOLLIN)
+                conn_read(s, c);
+            else if (events[i].events & (EPOLLHUP | EPOLLERR))
+                conn_close(s, c);
+        }
+        free_list(s->closed);
+        s->closed = NULL;
+    }
+}
+
+int server_run(const server_config *config)
+{
+    server s;
+    memset(&s, 0, sizeof(s));
+    s.cfg = *config;
+    s.epoll_fd = s.listen_fd = s.wake_fd = s.signal_fd = -1;
+    if (s.cfg.n_threads <= 0)
+        s.cfg.n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (s.cfg.cache_blocks == 0)
+        s.cfg.cache_blocks = 1;
+    if (s.cfg.limit < BLOCK_NUMBERS)
+        s.cfg.limit = BLOCK_NUMBERS;
+    pthread_mutex_init(&s.cache_lock, NULL);
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.cond, NULL);
+    atomic_init(&s.cancel, false);
+    pthread_t *threads = (pthread_t *)calloc(s.cfg.n_threads, sizeof(pthread_t));
+    int n_started = 0;
+    int ret = -1;
+
+    // the signals are read from signal_fd: block them in every thread, the workers inherit the mask
+    sigset_t signals, old_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+
+    if (threads == NULL || base_primes_init(&s.bp, isqrt(limit_block_end(s.cfg.limit))) != 0)
+        goto done;
+    s.slots = (block_slot *)calloc(s.cfg.cache_blocks, sizeof(block_slot));
+    s.blocks = (uint8_t *)sieve_alloc(s.cfg.cache_blocks * SERVER_BLOCK_BYTES);
+    if (s.slots == NULL || s.blocks == NULL)
+        goto done;
+    s.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    s.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    s.signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    s.listen_fd = listen_on(s.cfg.socket_path);
+    if (s.epoll_fd < 0 || s.wake_fd < 0 || s.signal_fd < 0 || s.listen_fd < 0 ||
+        watch_fd(&s, s.listen_fd, &s.listen_fd) != 0 || watch_fd(&s, s.wake_fd, &s.wake_fd) != 0 ||
+        watch_fd(&s, s.signal_fd, &s.signal_fd) != 0)
+        goto done;
+    for (; n_started < s.cfg.n_threads; n_started++)
+    {
+        if (pthread_create(&threads[n_started], NULL, worker, &s) != 0)
+            goto done;
+    }
+    event_loop(&s);
+    ret = 0;
+
+done:
+    atomic_store_explicit(&s.cancel, true, memory_order_relaxed);
+    pthread_mutex_lock(&s.lock);
+    s.stop = true;
+    pthread_cond_broadcast(&s.cond);
+    pthread_mutex_unlock(&s.lock);
+    for (int i = 0; i < n_started; i++)
+        pthread_join(threads[i], NULL);
+    // the workers answered every queued batch before stopping, the long counts cancelled
+    while (s.done != NULL)
+    {
+        job *j = s.done;
+        s.done = j->next;
+        free(j->out);
+        free(j->queries);
+        free(j);
+    }
+    free_list(s.connections);
+    free_list(s.closed);
+    if (s.listen_fd >= 0)
+    {
+        close(s.listen_fd);
+        unlink(s.cfg.socket_path);
+    }
+    if (s.signal_fd >= 0)
+        close(s.signal_fd);
+    if (s.wake_fd >= 0)
+        close(s.wake_fd);
+    if (s.epoll_fd >= 0)
+        close(s.epoll_fd);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    sieve_free(s.blocks);
+    free(s.slots);
+    free(threads);
+    base_primes_free(&s.bp);
+    pthread_cond_destroy(&s.cond);
+    pthread_mutex_destroy(&s.lock);
+    pthread_mutex_destroy(&s.cache_lock);
+    return ret;
+}
+
+/*
+ * Client
+ */
+
+static int send_all(int fd, const void *data, size_t size)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    while (size > 0)
+    {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int recv_all(int fd, void *data, size_t size)
+{
+    uint8_t *p = (uint8_t *)data;
+    while (size > 0)
+    {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+int server_connect(const char *socket_path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(addr.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int server_call(int fd, const server_query *queries, uint32_t n, server_answer *answers, uint64_t **storage)
+{
+    *storage = NULL;
+    if (n > SERVER_MAX_QUERIES)
+        return -1;
+    server_header header = {.magic = SERVER_MAGIC, .count = n};
+    if (send_all(fd, &header, sizeof(header)) != 0 || send_all(fd, queries, (size_t)n * sizeof(server_query)) != 0 ||
+        recv_all(fd, &header, sizeof(header)) != 0 || header.magic != SERVER_MAGIC || header.count != n)
+        return -1;
+    uint64_t *values = NULL;
+    uint64_t n_values = 0;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        server_result r;
+        if (recv_all(fd, &r, sizeof(r)) != 0)
+            goto fail;
+        answers[i].status = (server_status)r.status;
+        answers[i].n_values = r.n_values;
+        if (r.n_values > 0)
+        {
+            uint64_t *grown = (uint64_t *)realloc(values, (n_values + r.n_values) * sizeof(uint64_t));
+            if (grown == NULL)
+                goto fail;
+            values = grown;
+            if (recv_all(fd, values + n_values, r.n_values * sizeof(uint64_t)) != 0)
+                goto fail;
+        }
+        // offset for now: values moves while it grows
+        answers[i].values = (const uint64_t *)(uintptr_t)n_values;
+        n_values += r.n_values;
+    }
+    for (uint32_t i = 0; i < n; i++)
+        answers[i].values = values == NULL ? NULL : values + (uintptr_t)answers[i].values;
+    *storage = values;
+    return 0;
+
+fail:
+    free(values);
+    return -1;
+}
@@ -0,0 +1,223 @@
+#include "sieve.h"
+#include "backend.h"
+#include "wheel.h"
+#include "cache.h"
+#include "lmo.h"
+#include "query.h"
+#include "profile.h"
+#include "alloc.h"
+#include "tune.h"
+#include "analytics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const sieve_backend_ops *backends[SIEVE_BACKEND_COUNT] = {
+    [SIEVE_BACKEND_SEQUENTIAL] = &backend_sequential,
+    [SIEVE_BACKEND_PTHREAD] = &backend_pthread,
+    [SIEVE_BACKEND_OPENMP] = &backend_openmp,
+#ifdef SIEVE_HAVE_MPI
+    [SIEVE_BACKEND_MPI] = &backend_mpi,
+    [SIEVE_BACKEND_MPI_COLLECTIVE] = &backend_mpi_collective,
+    [SIEVE_BACKEND_MPI_HYBRID] = &backend_mpi_hybrid,
+#endif
+};
+
+static const char *format_names[SIEVE_FORMAT_COUNT] = {
+    [SIEVE_FORMAT_TEXT] = "text",
+    [SIEVE_FORMAT_U64] = "u64",
+    [SIEVE_FORMAT_DELTA] = "delta",
+};
+
+static const char *query_names[SIEVE_QUERY_COUNT] = {
+    [SIEVE_QUERY_NTH] = "nth prime",
+    [SIEVE_QUERY_NEXT] = "next prime",
+    [SIEVE_QUERY_PREV] = "previous prime",
+};
+
+static const char *backend_names[SIEVE_BACKEND_COUNT] = {
+    [SIEVE_BACKEND_SEQUENTIAL] = "sequential",
+    [SIEVE_BACKEND_PTHREAD] = "pthread",
+    [SIEVE_BACKEND_OPENMP] = "openmp",
+    [SIEVE_BACKEND_MPI] = "mpi",
+    [SIEVE_BACKEND_MPI_COLLECTIVE] = "mpi_collective",
+    [SIEVE_BACKEND_MPI_HYBRID] = "mpi_hybrid",
+};
+
+void sieve_config_init(sieve_config *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->backend = SIEVE_BACKEND_SEQUENTIAL;
+    cfg->output = SIEVE_OUTPUT_AUTO;
+}
+
+static bool lists_primes(const sieve_config *cfg)
+{
+    return cfg->output == SIEVE_OUTPUT_LIST || (cfg->output == SIEVE_OUTPUT_AUTO && cfg->max - cfg->min <= 100);
+}
+
+static bool is_mpi(sieve_backend backend)
+{
+    return backend == SIEVE_BACKEND_MPI || backend == SIEVE_BACKEND_MPI_COLLECTIVE || backend == SIEVE_BACKEND_MPI_HYBRID;
+}
+
+bool backend_needs_bits(const sieve_config *cfg)
+{
+    return lists_primes(cfg) || cfg->keep_bits;
+}
+
+int backend_threads(const sieve_config *cfg)
+{
+    return cfg->backend == SIEVE_BACKEND_SEQUENTIAL ? 1 : cfg->n_threads;
+}
+
+int sieve_run(const sieve_config *cfg, sieve_result *res)
+{
+    // what the caller leaves at 0 comes from the profile of this machine
+    sieve_config tuned = *cfg;
+    tune_apply(&tuned);
+    cfg = &tuned;
+    memset(res, 0, sizeof(*res));
+    res->min = cfg->min;
+    res->max = cfg->max;
+    if (!sieve_backend_available(cfg->backend) || cfg->min > cfg->max)
+        return -1;
+    if (cfg->query != SIEVE_QUERY_NONE)
+        return is_mpi(cfg->backend) ? -1 : query_run(cfg, res);
+    if (cfg->output == SIEVE_OUTPUT_STREAM)
+    {
+        if (backends[cfg->backend]->stream == NULL)
+            return -1;
+        return backends[cfg->backend]->stream(cfg, res);
+    }
+    if (cfg->output == SIEVE_OUTPUT_ANALYTICS)
+    {
+        if (backends[cfg->backend]->analyze == NULL)
+            return -1;
+        return backends[cfg->backend]->analyze(cfg, res);
+    }
+    int ret;
+    if (cfg->method == SIEVE_METHOD_LMO && !backend_needs_bits(cfg))
+    {
+        if (is_mpi(cfg->backend))
+            return -1;
+        ret = lmo_run(cfg, res);
+    }
+    else if (cfg->cache_path != NULL)
+    {
+        if (is_mpi(cfg->backend))
+            return -1;
+        ret = cache_run(cfg, res);
+    }
+    else
+    {
+        ret = backends[cfg->backend]->run(cfg, res);
+    }
+    if (ret != 0)
+    {
+        sieve_result_free(res);
+        return -1;
+    }
+    if (!backend_needs_bits(cfg))
+    {
+        sieve_free(res->bits);
+        res->bits = NULL;
+    }
+    return 0;
+}
+
+void sieve_result_free(sieve_result *res)
+{
+    sieve_free(res->bits);
+    res->bits = NULL;
+    free(res->analytics);
+    res->analytics = NULL;
+}
+
+uint64_t sieve_count_range(const sieve_result *res, uint64_t low, uint64_t high)
+{
+    if (res->bits == NULL)
+        return 0;
+    return wheel_count(res->bits, res->min / WHEEL_SPAN, low > res->min ? low : res->min,
+                       high < res->max ? high : res->max);
+}
+
+void sieve_print_primes(const sieve_config *cfg, const sieve_result *res)
+{
+    if (res->rank != 0 || cfg->output == SIEVE_OUTPUT_NONE || cfg->output == SIEVE_OUTPUT_STREAM)
+        return;
+    PROFILE_BEGIN(PROFILE_OUTPUT);
+    if (cfg->query != SIEVE_QUERY_NONE)
+    {
+        if (res->prime != 0)
+            printf("%s: %lu\n", query_names[cfg->query], res->prime);
+        else
+            printf("%s: none\n", query_names[cfg->query]);
+    }
+    else if (cfg->output == SIEVE_OUTPUT_ANALYTICS && res->analytics != NULL)
+    {
+        analytics_print(stdout, res->analytics);
+    }
+    else if (lists_primes(cfg) && res->bits != NULL)
+    {
+        // walk from prime to prime: a loop up to max would not end at 2^64 - 1
+        uint64_t first_byte = res->min / WHEEL_SPAN;
+        uint64_t p = res->min;
+        if (!wheel_is_prime(res->bits, first_byte, p))
+            p = wheel_next_prime(res->bits, first_byte, res->max, p);
+        for (; p != 0; p = wheel_next_prime(res->bits, first_byte, res->max, p))
+            printf("%lu ", p);
+        printf("\n");
+    }
+    else
+    {
+        printf("prime count: %lu\n", res->count);
+    }
+    PROFILE_END(PROFILE_OUTPUT);
+}
+
+const char *sieve_backend_name(sieve_backend backend)
+{
+    if (backend < 0 || backend >= SIEVE_BACKEND_COUNT)
+        return "unknown";
+    return backend_names[backend];
+}
+
+int sieve_backend_from_name(const char *name, sieve_backend *backend)
+{
+    for (int b = 0; b < SIEVE_BACKEND_COUNT; b++)
+    {
+        if (strcmp(name, backend_names[b]) == 0)
+        {
+            *backend = (sieve_backend)b;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+bool sieve_backend_available(sieve_backend backend)
+{
+    return backend >= 0 && backend < SIEVE_BACKEND_COUNT && backends[backend] != NULL;
+}
+
+const char *sieve_format_name(sieve_format format)
+{
+    if (format < 0 || format >= SIEVE_FORMAT_COUNT)
+        return "unknown";
+    return format_names[format];
+}
+
+int sieve_format_from_name(const char *name, sieve_format *format)
+{
+    for (int f = 0; f < SIEVE_FORMAT_COUNT; f++)
+    {
+        if (strcmp(name, format_names[f]) == 0)
+        {
+            *format = (sieve_format)f;
+            return 0;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,237 @@
+#include "spf.h"
+#include "scheduler.h"
+#include "alloc.h"
+#include "wheel.h"
+#include "profile.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** Index of the first base prime in the table: 2, 3 and 5 are not on the wheel */
+#define FIRST_WHEEL_PRIME 3
+
+typedef struct
+{
+    spf_table *t;
+    uint64_t n_bytes; // wheel bytes of the table
+} fill_task;
+
+/**
+ * Move every base prime to its first multiple coprime to 30 from max(p^2, 30 * byte)
+ */
+static void fill_seek(const spf_table *t, uint64_t byte, uint64_t *next, uint8_t *wi)
+{
+    uint64_t low = byte * WHEEL_SPAN;
+    for (size_t k = FIRST_WHEEL_PRIME; k < t->bp.count; k++)
+    {
+        uint64_t p = t->bp.primes[k];
+        uint64_t start = low > p * p ? low : p * p;
+        uint64_t m = start / p + (start % p != 0);
+        while (wheel_index[m % WHEEL_SPAN] == 0xff)
+            m++;
+        next[k] = p * m / WHEEL_SPAN;
+        wi[k] = wheel_index[m % WHEEL_SPAN];
+    }
+}
+
+/**
+ * Fill the entries of the wheel bytes [first_byte, end)
+ *
+ * The largest primes go first: every entry ends up with the last, smallest,
+ * prime that wrote it, without reading it back.
+ */
+static void fill_segment(const spf_table *t, uint64_t first_byte, uint64_t end, uint64_t *next, uint8_t *wi)
+{
+    uint16_t *entries = t->entries;
+    memset(entries + first_byte * 8, 0, (end - first_byte) * 8 * sizeof(uint16_t));
+    for (size_t k = t->bp.count; k-- > FIRST_WHEEL_PRIME;)
+    {
+        uint64_t i = next[k];
+        if (i >= end)
+            continue;
+        uint64_t p = t->bp.primes[k];
+        uint64_t q = p / WHEEL_SPAN;
+        const wheel_step *steps = wheel_steps[wheel_index[p % WHEEL_SPAN]];
+        unsigned j = wi[k];
+        while (i < end)
+        {
+            entries[i * 8 + __builtin_ctz(steps[j].mask)] = (uint16_t)k;
+            i += q * wheel_deltas[j] + steps[j].carry;
+            j = (j + 1) & 7;
+        }
+        next[k] = i;
+        wi[k] = j;
+    }
+}
+
+static int fill_thread(segment_scheduler *sched, int id, void *arg)
+{
+    const fill_task *w = (const fill_task *)arg;
+    const spf_table *t = w->t;
+    uint64_t *next = (uint64_t *)malloc(t->bp.count * sizeof(uint64_t));
+    uint8_t *wi = (uint8_t *)malloc(t->bp.count);
+    if (next == NULL || wi == NULL)
+    {
+        free(next);
+        free(wi);
+        return -1;
+    }
+    uint64_t segment;
+    bool contiguous;
+    bool positioned = false;
+    while (scheduler_next(sched, id, &segment, &contiguous))
+    {
+        uint64_t first_byte = segment * SPF_SEGMENT_BYTES;
+        uint64_t end = first_byte + SPF_SEGMENT_BYTES < w->n_bytes ? first_byte + SPF_SEGMENT_BYTES : w->n_bytes;
+        if (!positioned || !contiguous)
+            fill_seek(t, first_byte, next, wi);
+        positioned = true;
+        PROFILE_BEGIN(PROFILE_CROSS_OFF);
+        fill_segment(t, first_byte, end, next, wi);
+        PROFILE_END(PROFILE_CROSS_OFF);
+    }
+    free(next);
+    free(wi);
+    return 0;
+}
+
+int spf_table_init(spf_table *t, uint64_t limit, int n_threads)
+{
+    memset(t, 0, sizeof(*t));
+    if (limit > SPF_MAX_LIMIT)
+        return -1;
+    if (n_threads <= 0)
+        n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    t->limit = limit;
+    uint64_t n_bytes = wheel_size(0, limit);
+    uint64_t n_segments = (n_bytes + SPF_SEGMENT_BYTES - 1) / SPF_SEGMENT_BYTES;
+    if ((uint64_t)n_threads > n_segments)
+        n_threads = (int)n_segments;
+    t->entries = (uint16_t *)sieve_alloc(n_bytes * 8 * sizeof(uint16_t));
+    int ret = -1;
+    if (t->entries != NULL && base_primes_init(&t->bp, isqrt(limit)) == 0)
+    {
+        fill_task task = {.t = t, .n_bytes = n_bytes};
+        ret = scheduler_run(n_threads, n_segments, fill_thread, &task);
+    }
+    if (ret != 0)
+        spf_table_free(t);
+    return ret;
+}
+
+void spf_table_free(spf_table *t)
+{
+    sieve_free(t->entries);
+    t->entries = NULL;
+    base_primes_free(&t->bp);
+}
+
+/**
+ * Smallest prime factor of n coprime to 30, n itself when it is prime
+ */
+static inline uint64_t wheel_factor(const spf_table *t, uint64_t n)
+{
+    uint16_t k = t->entries[n / WHEEL_SPAN * 8 + wheel_index[n % WHEEL_SPAN]];
+    return k != 0 ? t->bp.primes[k] : n;
+}
+
+uint64_t spf_smallest_factor(const spf_table *t, uint64_t n)
+{
+    if (n % 2 == 0)
+        return 2;
+    if (n % 3 == 0)
+        return 3;
+    if (n % 5 == 0)
+        return 5;
+    return wheel_factor(t, n);
+}
+
+static inline void push_factor(spf_factorization *f, uint64_t p, unsigned e)
+{
+    f->primes[f->n_factors] = p;
+    f->exponents[f->n_factors++] = (uint8_t)e;
+}
+
+int spf_factor(const spf_table *t, uint64_t n, spf_factorization *f)
+{
+    f->n_factors = 0;
+    if (n == 0 || n > t->limit)
+        return -1;
+    unsigned twos = __builtin_ctzll(n);
+    if (twos > 0)
+        push_factor(f, 2, twos);
+    n >>= twos;
+    for (uint64_t p = 3; p <= 5; p += 2)
+    {
+        unsigned e = 0;
+        for (; n % p == 0; e++)
+            n /= p;
+        if (e > 0)
+            push_factor(f, p, e);
+    }
+    // one lookup per distinct prime factor, the largest one being its own factor
+    while (n > 1)
+    {
+        uint64_t p = wheel_factor(t, n);
+        unsigned e = 0;
+        do
+        {
+            n /= p;
+            e++;
+        } while (n % p == 0);
+        push_factor(f, p, e);
+    }
+    return 0;
+}
+
+typedef struct
+{
+    const spf_table *t;
+    const uint64_t *numbers;
+    size_t n;
+    spf_factorization *out;
+    size_t *failed; // per worker
+} batch_task;
+
+static int batch_thread(segment_scheduler *sched, int id, void *arg)
+{
+    const batch_task *w = (const batch_task *)arg;
+    uint64_t chunk;
+    bool contiguous;
+    while (scheduler_next(sched, id, &chunk, &contiguous))
+    {
+        size_t end = (chunk + 1) * SPF_BATCH_CHUNK < w->n ? (chunk + 1) * SPF_BATCH_CHUNK : w->n;
+        for (size_t i = chunk * SPF_BATCH_CHUNK; i < end; i++)
+            w->failed[id] += spf_factor(w->t, w->numbers[i], &w->out[i]) != 0;
+    }
+    return 0;
+}
+
+size_t spf_factor_batch(const spf_table *t, const uint64_t *numbers, size_t n, spf_factorization *out,
+                        int n_threads)
+{
+    if (n == 0)
+        return 0;
+    if (n_threads <= 0)
+        n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t n_chunks = (n + SPF_BATCH_CHUNK - 1) / SPF_BATCH_CHUNK;
+    if ((uint64_t)n_threads > n_chunks)
+        n_threads = (int)n_chunks;
+    size_t *failed_by = (size_t *)calloc(n_threads, sizeof(size_t));
+    batch_task task = {.t = t, .numbers = numbers, .n = n, .out = out, .failed = failed_by};
+    size_t failed = 0;
+    if (failed_by == NULL || scheduler_run(n_threads, n_chunks, batch_thread, &task) != 0)
+    {
+        // no pool: factor them here
+        for (size_t i = 0; i < n; i++)
+            failed += spf_factor(t, numbers[i], &out[i]) != 0;
+    }
+    else
+    {
+        for (int i = 0; i < n_threads; i++)
+            failed += failed_by[i];
+    }
+    free(failed_by);
+    return failed;
+}
@@ -0,0 +1,399 @@
+#include "stream.h"
+#include "segment.h"
+#include "wheel.h"
+#include "timer.h"
+#include "profile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+/** Two decimal digits per entry, so that the formatter divides by 100 */
+static const char digit_pairs[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/** Longest varint of a 64 bit value */
+#define VARINT_MAX 10
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/**
+ * Primes of one task: the bytes to write and, for the delta format, the first
+ * prime whose difference with the previous task is only known by the writer
+ */
+typedef struct
+{
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    uint8_t header[VARINT_MAX]; // delta of the first prime, filled by the writer
+    uint64_t first;             // first prime of the task, 0 if there is none
+    uint64_t last;              // last prime of the task
+    uint64_t count;
+    bool ready;                 // encoded, waiting to be written
+} stream_slot;
+
+typedef struct
+{
+    const sieve_config *cfg;
+    const base_primes *bp;
+    uint64_t first_byte;    // byte of cfg->min
+    uint64_t n_bytes;       // bytes of the range
+    uint64_t segment_bytes;
+    uint64_t task_bytes;    // bytes per task
+    uint64_t n_tasks;
+    stream_slot *slots;     // ring of buffers, task t uses slots[t % n_slots]
+    int n_slots;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;   // a slot has been encoded
+    pthread_cond_t free;    // a slot has been written
+    uint64_t next_task;     // next task to hand out
+    uint64_t written;       // tasks before this one are written, their slots can be reused
+    bool failed;
+} stream_pipeline;
+
+static uint8_t *encode_decimal(uint8_t *out, uint64_t n)
+{
+    char buf[20];
+    char *p = buf + sizeof(buf);
+    while (n >= 100)
+    {
+        unsigned r = (unsigned)(n % 100);
+        n /= 100;
+        p -= 2;
+        memcpy(p, digit_pairs + 2 * r, 2);
+    }
+    if (n >= 10)
+    {
+        p -= 2;
+        memcpy(p, digit_pairs + 2 * n, 2);
+    }
+    else
+    {
+        *--p = (char)('0' + n);
+    }
+    size_t len = buf + sizeof(buf) - p;
+    memcpy(out, p, len);
+    out[len] = '\n';
+    return out + len + 1;
+}
+
+static uint8_t *encode_varint(uint8_t *out, uint64_t n)
+{
+    while (n >= 0x80)
+    {
+        *out++ = (uint8_t)(n | 0x80);
+        n >>= 7;
+    }
+    *out++ = (uint8_t)n;
+    return out;
+}
+
+uint8_t *stream_encode(sieve_format format, uint8_t *out, uint64_t p, uint64_t prev)
+{
+    switch (format)
+    {
+    case SIEVE_FORMAT_U64:
+        for (int i = 0; i < 8; i++)
+            out[i] = (uint8_t)(p >> (8 * i));
+        return out + 8;
+    case SIEVE_FORMAT_DELTA:
+        return encode_varint(out, p - prev);
+    default:
+        return encode_decimal(out, p);
+    }
+}
+
+/**
+ * Sieve and encode one task into its slot
+ */
+static int encode_task(stream_pipeline *pl, sieve_state *st, uint8_t *segment, uint64_t task, stream_slot *slot)
+{
+    const sieve_config *cfg = pl->cfg;
+    uint64_t offset = task * pl->task_bytes;
+    uint64_t size = pl->n_bytes - offset < pl->task_bytes ? pl->n_bytes - offset : pl->task_bytes;
+    slot->size = 0;
+    slot->first = 0;
+    slot->last = 0;
+    slot->count = 0;
+    sieve_state_seek(st, (pl->first_byte + offset) * WHEEL_SPAN);
+    for (uint64_t s = 0; s < size; s += pl->segment_bytes)
+    {
+        uint64_t byte = pl->first_byte + offset + s;
+        uint64_t n_bytes = size - s < pl->segment_bytes ? size - s : pl->segment_bytes;
+        uint64_t count = sieve_segment(st, segment, byte, n_bytes, cfg->min);
+        // the popcount gives the exact room the segment needs
+        if (slot->size + count * STREAM_MAX_ENCODED > slot->capacity)
+        {
+            size_t capacity = slot->size + count * STREAM_MAX_ENCODED;
+            uint8_t *data = (uint8_t *)realloc(slot->data, capacity);
+            if (data == NULL)
+                return -1;
+            slot->data = data;
+            slot->capacity = capacity;
+        }
+        PROFILE_BEGIN(PROFILE_OUTPUT);
+        uint8_t *out = slot->data + slot->size;
+        for (uint64_t i = 0; i < n_bytes; i++)
+        {
+            for (uint8_t word = segment[i]; word != 0; word &= word - 1)
+            {
+                uint64_t p = (byte + i) * WHEEL_SPAN + wheel_residues[__builtin_ctz(word)];
+                if (slot->first == 0)
+                    slot->first = p;
+                // the delta of the first prime depends on the previous task: the writer adds it
+                if (cfg->format != SIEVE_FORMAT_DELTA || p != slot->first)
+                    out = stream_encode(cfg->format, out, p, slot->last);
+                slot->last = p;
+            }
+        }
+        slot->size = out - slot->data;
+        slot->count += count;
+        PROFILE_END(PROFILE_OUTPUT);
+    }
+    return 0;
+}
+
+static void *encode_tasks(void *parameters)
+{
+    stream_pipeline *pl = (stream_pipeline *)parameters;
+    sieve_state st;
+    uint8_t *segment = (uint8_t *)malloc(pl->segment_bytes);
+    bool failed = segment == NULL || sieve_state_init(&st, pl->bp, pl->cfg->max, pl->segment_bytes) != 0;
+    while (!failed)
+    {
+        pthread_mutex_lock(&pl->lock);
+        // wait until the writer has released the slot of the next task
+        while (!pl->failed && pl->next_task < pl->n_tasks && pl->next_task >= pl->written + pl->n_slots)
+            pthread_cond_wait(&pl->free, &pl->lock);
+        if (pl->failed || pl->next_task >= pl->n_tasks)
+        {
+            pthread_mutex_unlock(&pl->lock);
+            break;
+        }
+        uint64_t task = pl->next_task++;
+        pthread_mutex_unlock(&pl->lock);
+
+        stream_slot *slot = &pl->slots[task % pl->n_slots];
+        failed = encode_task(pl, &st, segment, task, slot) != 0;
+        pthread_mutex_lock(&pl->lock);
+        slot->ready = true;
+        pthread_cond_broadcast(&pl->ready);
+        pthread_mutex_unlock(&pl->lock);
+    }
+    if (failed)
+    {
+        pthread_mutex_lock(&pl->lock);
+        pl->failed = true;
+        pthread_cond_broadcast(&pl->ready);
+        pthread_cond_broadcast(&pl->free);
+        pthread_mutex_unlock(&pl->lock);
+    }
+    if (segment != NULL)
+        sieve_state_free(&st);
+    free(segment);
+    return NULL;
+}
+
+/**
+ * Write every iovec, resuming after partial writes
+ */
+static int write_all(int fd, struct iovec *iov, int n_iov)
+{
+    int ret = 0;
+    PROFILE_BEGIN(PROFILE_OUTPUT);
+    while (ret == 0 && n_iov > 0)
+    {
+        ssize_t written = writev(fd, iov, n_iov);
+        if (written < 0)
+        {
+            if (errno != EINTR)
+                ret = -1;
+            continue;
+        }
+        while (n_iov > 0 && (size_t)written >= iov->iov_len)
+        {
+            written -= iov->iov_len;
+            iov++;
+            n_iov--;
+        }
+        if (n_iov > 0)
+        {
+            iov->iov_base = (uint8_t *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    PROFILE_END(PROFILE_OUTPUT);
+    return ret;
+}
+
+/**
+ * Write the tasks in order as they are encoded, in batches of consecutive ready slots
+ */
+static int write_tasks(stream_pipeline *pl, int fd, uint64_t *prev, uint64_t *count)
+{
+    int max_batch = pl->n_slots < IOV_MAX / 2 ? pl->n_slots : IOV_MAX / 2;
+    struct iovec *iov = (struct iovec *)malloc(2 * max_batch * sizeof(struct iovec));
+    if (iov == NULL)
+        return -1;
+    int ret = 0;
+    uint64_t task = 0;
+    while (task < pl->n_tasks)
+    {
+        pthread_mutex_lock(&pl->lock);
+        while (!pl->failed && !pl->slots[task % pl->n_slots].ready)
+            pthread_cond_wait(&pl->ready, &pl->lock);
+        uint64_t end = task;
+        while (end < pl->n_tasks && end - task < (uint64_t)max_batch && pl->slots[end % pl->n_slots].ready)
+            end++;
+        bool failed = pl->failed;
+        pthread_mutex_unlock(&pl->lock);
+        if (failed)
+        {
+            ret = -1;
+            break;
+        }
+
+        int n_iov = 0;
+        for (uint64_t t = task; t < end; t++)
+        {
+            stream_slot *slot = &pl->slots[t % pl->n_slots];
+            if (slot->first == 0)
+                continue;
+            if (pl->cfg->format == SIEVE_FORMAT_DELTA)
+            {
+                uint8_t *header_end = encode_varint(slot->header, slot->first - *prev);
+                iov[n_iov].iov_base = slot->header;
+                iov[n_iov++].iov_len = header_end - slot->header;
+            }
+            iov[n_iov].iov_base = slot->data;
+            iov[n_iov++].iov_len = slot->size;
+            *prev = slot->last;
+            *count += slot->count;
+        }
+        if (write_all(fd, iov, n_iov) != 0)
+        {
+            perror("write");
+            ret = -1;
+        }
+
+        pthread_mutex_lock(&pl->lock);
+        for (uint64_t t = task; t < end; t++)
+            pl->slots[t % pl->n_slots].ready = false;
+        pl->written = end;
+        if (ret != 0)
+            pl->failed = true;
+        pthread_cond_broadcast(&pl->free);
+        pthread_mutex_unlock(&pl->lock);
+        if (ret != 0)
+            break;
+        task = end;
+    }
+    free(iov);
+    return ret;
+}
+
+int stream_primes(const sieve_config *cfg, sieve_result *res, int n_threads)
+{
+    if (n_threads <= 0)
+        n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int fd = STDOUT_FILENO;
+    if (cfg->output_path != NULL && strcmp(cfg->output_path, "-") != 0)
+    {
+        fd = open(cfg->output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            perror(cfg->output_path);
+            return -1;
+        }
+    }
+    else
+    {
+        fflush(stdout); // keep what the caller printed before the primes
+    }
+
+    stream_pipeline pl;
+    memset(&pl, 0, sizeof(pl));
+    pl.cfg = cfg;
+    pl.first_byte = cfg->min / WHEEL_SPAN;
+    pl.n_bytes = wheel_size(cfg->min, cfg->max);
+    pl.segment_bytes = cfg->segment_bytes > 0 ? cfg->segment_bytes : SEGMENT_BYTES;
+    pl.task_bytes = pl.segment_bytes * STREAM_SEGMENTS_PER_TASK;
+    pl.n_tasks = (pl.n_bytes + pl.task_bytes - 1) / pl.task_bytes;
+    pl.n_slots = n_threads * STREAM_SLOTS_PER_THREAD;
+    pl.slots = (stream_slot *)calloc(pl.n_slots, sizeof(stream_slot));
+    pthread_t *threads = (pthread_t *)malloc(n_threads * sizeof(pthread_t));
+    pthread_mutex_init(&pl.lock, NULL);
+    pthread_cond_init(&pl.ready, NULL);
+    pthread_cond_init(&pl.free, NULL);
+
+    double start, end;
+    GET_TIME(start);
+    base_primes bp;
+    int ret = -1;
+    if (pl.slots == NULL || threads == NULL || base_primes_init(&bp, isqrt(cfg->max)) != 0)
+        goto out;
+    pl.bp = &bp;
+
+    // 2, 3 and 5 are not in the wheel
+    uint8_t small[3 * STREAM_MAX_ENCODED];
+    uint8_t *small_end = small;
+    uint64_t prev = 0;
+    uint64_t count = 0;
+    for (uint64_t p = 2; p <= 5; p += (p == 2 ? 1 : 2))
+    {
+        if (cfg->min <= p && p <= cfg->max)
+        {
+            small_end = stream_encode(cfg->format, small_end, p, prev);
+            prev = p;
+            count++;
+        }
+    }
+    struct iovec small_iov = {small, (size_t)(small_end - small)};
+    ret = write_all(fd, &small_iov, 1);
+
+    // not scheduler_run(): the caller writes while the encoders run, and the tasks go out in order through the slots
+    int created = 0;
+    for (; ret == 0 && created < n_threads; created++)
+    {
+        if (pthread_create(&threads[created], NULL, encode_tasks, &pl) != 0)
+            break;
+    }
+    if (ret == 0 && created == 0)
+        ret = -1;
+    if (ret == 0)
+        ret = write_tasks(&pl, fd, &prev, &count);
+    else
+        pl.failed = true;
+    for (int i = 0; i < created; i++)
+        pthread_join(threads[i], NULL);
+    GET_TIME(end);
+    base_primes_free(&bp);
+    res->count = count;
+    res->elapsed = end - start;
+
+out:
+    for (int i = 0; pl.slots != NULL && i < pl.n_slots; i++)
+        free(pl.slots[i].data);
+    free(pl.slots);
+    free(threads);
+    pthread_mutex_destroy(&pl.lock);
+    pthread_cond_destroy(&pl.ready);
+    pthread_cond_destroy(&pl.free);
+    if (fd != STDOUT_FILENO && close(fd) != 0)
+        ret = -1;
+    return ret;
+}
@@ -0,0 +1,359 @@
+#include "tune.h"
+#include "segment.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/** Start of the calibration window: base primes up to 10^6 and a few large ones, like the long runs */
+#define TUNE_LOW UINT64_C(1000000000000)
+/** Length of one calibration run */
+#define TUNE_RUN_SECONDS 0.1
+/** Runs per candidate, the fastest one counts */
+#define TUNE_TRIALS 3
+#define TUNE_MAX_CANDIDATES 8
+#define CPU_PATH "/sys/devices/system/cpu"
+
+typedef enum
+{
+    TUNE_SEGMENT,
+    TUNE_THREADS,
+    TUNE_CHUNKS
+} tune_param;
+
+static const char *param_names[] = {"segment_bytes", "threads", "chunks_per_thread"};
+
+/**
+ * First line of a file without its newline, empty if it cannot be read
+ */
+static void read_line(const char *path, char *line, size_t size)
+{
+    line[0] = '\0';
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return;
+    if (fgets(line, (int)size, f) != NULL)
+        line[strcspn(line, "\n")] = '\0';
+    fclose(f);
+}
+
+/**
+ * Cache size as written by sysfs ("48K", "32M") in bytes
+ */
+static uint64_t parse_size(const char *s)
+{
+    char *end;
+    uint64_t size = strtoul(s, &end, 10);
+    if (*end == 'K')
+        size <<= 10;
+    else if (*end == 'M')
+        size <<= 20;
+    return size;
+}
+
+void tune_topology_read(tune_topology *topo)
+{
+    topo->l1d_bytes = 0;
+    topo->l2_bytes = 0;
+    topo->l3_bytes = 0;
+    char path[128], line[64];
+    for (int index = 0; index < 8; index++)
+    {
+        snprintf(path, sizeof(path), CPU_PATH "/cpu0/cache/index%d/type", index);
+        read_line(path, line, sizeof(line));
+        if (line[0] == '\0')
+            break;
+        if (strcmp(line, "Instruction") == 0)
+            continue;
+        snprintf(path, sizeof(path), CPU_PATH "/cpu0/cache/index%d/level", index);
+        read_line(path, line, sizeof(line));
+        int level = atoi(line);
+        snprintf(path, sizeof(path), CPU_PATH "/cpu0/cache/index%d/size", index);
+        read_line(path, line, sizeof(line));
+        uint64_t size = parse_size(line);
+        if (level == 1)
+            topo->l1d_bytes = size;
+        else if (level == 2)
+            topo->l2_bytes = size;
+        else if (level == 3)
+            topo->l3_bytes = size;
+    }
+    if (topo->l1d_bytes == 0)
+        topo->l1d_bytes = SEGMENT_BYTES;
+    if (topo->l2_bytes == 0)
+        topo->l2_bytes = 8 * topo->l1d_bytes;
+
+    topo->cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (topo->cpus <= 0)
+        topo->cpus = 1;
+    // a core is counted once, on its first hardware thread
+    topo->cores = 0;
+    int configured = (int)sysconf(_SC_NPROCESSORS_CONF);
+    for (int cpu = 0; cpu < configured; cpu++)
+    {
+        snprintf(path, sizeof(path), CPU_PATH "/cpu%d/topology/thread_siblings_list", cpu);
+        read_line(path, line, sizeof(line));
+        if (line[0] != '\0' && atoi(line) == cpu)
+            topo->cores++;
+    }
+    if (topo->cores == 0 || topo->cores > topo->cpus)
+        topo->cores = topo->cpus;
+}
+
+/**
+ * Host name, cpu model and cpu count: a profile only applies to the machine that measured it
+ */
+static void machine_key(char *key, size_t size)
+{
+    char host[64] = "unknown";
+    char model[128] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    char line[256];
+    while (f != NULL && fgets(line, sizeof(line), f) != NULL)
+    {
+        if (strncmp(line, "model name", 10) == 0 && strchr(line, ':') != NULL)
+        {
+            const char *name = strchr(line, ':') + 1;
+            name += strspn(name, " \t");
+            snprintf(model, sizeof(model), "%.*s", (int)strcspn(name, "\n"), name);
+            break;
+        }
+    }
+    if (f != NULL)
+        fclose(f);
+    snprintf(key, size, "%s/%s/%ld", host, model, sysconf(_SC_NPROCESSORS_ONLN));
+}
+
+/**
+ * Insert v in the sorted candidates unless it is already there
+ */
+static void add_candidate(uint64_t *candidates, int *n, uint64_t v)
+{
+    int i = 0;
+    while (i < *n && candidates[i] < v)
+        i++;
+    if ((i < *n && candidates[i] == v) || *n == TUNE_MAX_CANDIDATES)
+        return;
+    memmove(candidates + i + 1, candidates + i, (*n - i) * sizeof(uint64_t));
+    candidates[i] = v;
+    (*n)++;
+}
+
+static void set_param(sieve_config *cfg, tune_param param, uint64_t value)
+{
+    if (param == TUNE_SEGMENT)
+        cfg->segment_bytes = value;
+    else if (param == TUNE_THREADS)
+        cfg->n_threads = (int)value;
+    else
+        cfg->chunks_per_thread = (int)value;
+}
+
+/**
+ * Fastest of TUNE_TRIALS runs of cfg, sieving time only
+ */
+static int measure(const sieve_config *cfg, double *seconds)
+{
+    *seconds = -1;
+    for (int t = 0; t < TUNE_TRIALS; t++)
+    {
+        sieve_result res;
+        if (sieve_run(cfg, &res) != 0)
+            return -1;
+        sieve_result_free(&res);
+        if (*seconds < 0 || res.elapsed < *seconds)
+            *seconds = res.elapsed;
+    }
+    return 0;
+}
+
+/**
+ * Time cfg with each candidate of param and leave the fastest one set
+ */
+static int sweep(sieve_config *cfg, tune_param param, const uint64_t *candidates, int n, FILE *log)
+{
+    uint64_t best = candidates[0];
+    double best_seconds = -1;
+    for (int i = 0; i < n; i++)
+    {
+        double seconds;
+        set_param(cfg, param, candidates[i]);
+        if (measure(cfg, &seconds) != 0)
+            return -1;
+        if (log != NULL)
+            fprintf(log, "[Tune] %s %s=%lu: %f s\n", sieve_backend_name(cfg->backend), param_names[param],
+                    candidates[i], seconds);
+        if (best_seconds < 0 || seconds < best_seconds)
+        {
+            best = candidates[i];
+            best_seconds = seconds;
+        }
+    }
+    set_param(cfg, param, best);
+    return 0;
+}
+
+int tune_calibrate(tune_profile *profile, FILE *log)
+{
+    tune_topology topo;
+    tune_topology_read(&topo);
+    if (log != NULL)
+        fprintf(log, "[Tune] L1d %lu B, L2 %lu B, L3 %lu B, %d cores, %d cpus\n", topo.l1d_bytes, topo.l2_bytes,
+                topo.l3_bytes, topo.cores, topo.cpus);
+    sieve_config cfg;
+    sieve_config_init(&cfg);
+    cfg.backend = SIEVE_BACKEND_PTHREAD;
+    cfg.output = SIEVE_OUTPUT_COUNT;
+    cfg.n_threads = topo.cpus;
+    cfg.segment_bytes = SEGMENT_BYTES;
+    cfg.chunks_per_thread = 32;
+
+    // window long enough for TUNE_RUN_SECONDS on this machine
+    uint64_t length = 1000000000;
+    double seconds;
+    cfg.min = TUNE_LOW;
+    cfg.max = TUNE_LOW + length - 1;
+    if (measure(&cfg, &seconds) != 0)
+        return -1;
+    double scaled = seconds > 0 ? length * TUNE_RUN_SECONDS / seconds : 1e11;
+    length = scaled < 1e8 ? 100000000 : scaled > 1e11 ? 100000000000 : (uint64_t)scaled;
+    cfg.max = TUNE_LOW + length - 1;
+
+    // the segment and its crossing-off state should stay in L1 or L2
+    uint64_t candidates[TUNE_MAX_CANDIDATES];
+    int n = 0;
+    uint64_t sizes[] = {topo.l1d_bytes / 2, topo.l1d_bytes, 2 * topo.l1d_bytes,
+                        topo.l2_bytes / 4, topo.l2_bytes / 2, topo.l2_bytes};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        add_candidate(candidates, &n, sizes[i] < 4096 ? 4096 : sizes[i]);
+    if (sweep(&cfg, TUNE_SEGMENT, candidates, n, log) != 0)
+        return -1;
+
+    // hardware threads share the L1 and L2 of a core: they do not always pay off
+    n = 0;
+    add_candidate(candidates, &n, topo.cores / 2 > 0 ? topo.cores / 2 : 1);
+    add_candidate(candidates, &n, topo.cores);
+    add_candidate(candidates, &n, (topo.cores + topo.cpus) / 2);
+    add_candidate(candidates, &n, topo.cpus);
+    if (sweep(&cfg, TUNE_THREADS, candidates, n, log) != 0)
+        return -1;
+
+    // fewer chunks keep the base primes positioned, more balance the load
+    cfg.backend = SIEVE_BACKEND_OPENMP;
+    uint64_t chunks[] = {4, 16, 32, 128};
+    if (sweep(&cfg, TUNE_CHUNKS, chunks, 4, log) != 0)
+        return -1;
+
+    profile->segment_bytes = cfg.segment_bytes;
+    profile->n_threads = cfg.n_threads;
+    profile->chunks_per_thread = cfg.chunks_per_thread;
+    return 0;
+}
+
+int tune_path(char *path, size_t size)
+{
+    const char *file = getenv("SIEVE_TUNE_FILE");
+    if (file != NULL)
+    {
+        if (file[0] == '\0')
+            return -1;
+        snprintf(path, size, "%s", file);
+        return 0;
+    }
+    char host[64] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    const char *cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (cache != NULL && cache[0] != '\0')
+        snprintf(path, size, "%s/libsieve/%s.tune", cache, host);
+    else if (home != NULL && home[0] != '\0')
+        snprintf(path, size, "%s/.cache/libsieve/%s.tune", home, host);
+    else
+        return -1;
+    return 0;
+}
+
+int tune_save(const tune_profile *profile)
+{
+    char path[512], key[256];
+    if (tune_path(path, sizeof(path)) != 0)
+        return -1;
+    // create the missing directories of the default path, one level at a time
+    for (char *slash = strchr(path + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/'))
+    {
+        *slash = '\0';
+        mkdir(path, 0755);
+        *slash = '/';
+    }
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+        return -1;
+    machine_key(key, sizeof(key));
+    fprintf(f, "# libsieve tuning profile, written by sieve_bench --autotune\n");
+    fprintf(f, "machine=%s\n", key);
+    fprintf(f, "segment_bytes=%lu\n", profile->segment_bytes);
+    fprintf(f, "threads=%d\n", profile->n_threads);
+    fprintf(f, "chunks_per_thread=%d\n", profile->chunks_per_thread);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+int tune_load(tune_profile *profile)
+{
+    char path[512], key[256], line[512];
+    if (tune_path(path, sizeof(path)) != 0)
+        return -1;
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return -1;
+    machine_key(key, sizeof(key));
+    bool same_machine = false;
+    memset(profile, 0, sizeof(*profile));
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        line[strcspn(line, "\n")] = '\0';
+        char *value = strchr(line, '=');
+        if (line[0] == '#' || value == NULL)
+            continue;
+        *value++ = '\0';
+        if (strcmp(line, "machine") == 0)
+            same_machine = strcmp(value, key) == 0;
+        else if (strcmp(line, "segment_bytes") == 0)
+            profile->segment_bytes = strtoul(value, NULL, 10);
+        else if (strcmp(line, "threads") == 0)
+            profile->n_threads = atoi(value);
+        else if (strcmp(line, "chunks_per_thread") == 0)
+            profile->chunks_per_thread = atoi(value);
+    }
+    fclose(f);
+    if (!same_machine || profile->segment_bytes == 0 || profile->n_threads <= 0 || profile->chunks_per_thread <= 0)
+        return -1;
+    return 0;
+}
+
+/** Profile of this machine, read by the first sieve_run() of the process */
+static tune_profile tune_loaded;
+static bool tune_found = false;
+static pthread_once_t tune_once = PTHREAD_ONCE_INIT;
+
+static void tune_load_once(void)
+{
+    tune_found = tune_load(&tune_loaded) == 0;
+}
+
+void tune_apply(sieve_config *cfg)
+{
+    if (cfg->segment_bytes != 0 && cfg->n_threads != 0 && cfg->chunks_per_thread != 0)
+        return;
+    pthread_once(&tune_once, tune_load_once);
+    if (!tune_found)
+        return;
+    if (cfg->segment_bytes == 0)
+        cfg->segment_bytes = tune_loaded.segment_bytes;
+    if (cfg->n_threads == 0)
+        cfg->n_threads = tune_loaded.n_threads;
+    if (cfg->chunks_per_thread == 0)
+        cfg->chunks_per_thread = tune_loaded.chunks_per_thread;
+}
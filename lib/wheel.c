@@ -0,0 +1,77 @@
+#include "wheel.h"
+#include "popcount.h"
+
+
+const uint8_t wheel_residues[8] = {1, 7, 11, 13, 17, 19, 23, 29};
+
+const uint8_t wheel_deltas[8] = {6, 4, 2, 4, 2, 4, 6, 2};
+
+const uint8_t wheel_bit[WHEEL_SPAN] = {
+    0, 0x01, 0, 0, 0, 0, 0, 0x02, 0, 0,
+    0, 0x04, 0, 0x08, 0, 0, 0, 0x10, 0, 0x20,
+    0, 0, 0, 0x40, 0, 0, 0, 0, 0, 0x80};
+
+const uint8_t wheel_index[WHEEL_SPAN] = {
+    0xff, 0, 0xff, 0xff, 0xff, 0xff, 0xff, 1, 0xff, 0xff,
+    0xff, 2, 0xff, 3, 0xff, 0xff, 0xff, 4, 0xff, 5,
+    0xff, 0xff, 0xff, 6, 0xff, 0xff, 0xff, 0xff, 0xff, 7};
+
+const wheel_step wheel_steps[8][8] = {
+    {{0x01, 0}, {0x02, 0}, {0x04, 0}, {0x08, 0}, {0x10, 0}, {0x20, 0}, {0x40, 0}, {0x80, 1}}, // p % 30 == 1
+    {{0x02, 1}, {0x20, 1}, {0x10, 1}, {0x01, 0}, {0x80, 1}, {0x08, 1}, {0x04, 1}, {0x40, 1}}, // p % 30 == 7
+    {{0x04, 2}, {0x10, 2}, {0x01, 0}, {0x40, 2}, {0x02, 0}, {0x80, 2}, {0x08, 2}, {0x20, 1}}, // p % 30 == 11
+    {{0x08, 3}, {0x01, 1}, {0x40, 1}, {0x20, 2}, {0x04, 1}, {0x02, 1}, {0x80, 3}, {0x10, 1}}, // p % 30 == 13
+    {{0x10, 3}, {0x80, 3}, {0x02, 1}, {0x04, 2}, {0x20, 1}, {0x40, 3}, {0x01, 3}, {0x08, 1}}, // p % 30 == 17
+    {{0x20, 4}, {0x08, 2}, {0x80, 2}, {0x02, 2}, {0x40, 2}, {0x01, 2}, {0x10, 4}, {0x04, 1}}, // p % 30 == 19
+    {{0x40, 5}, {0x04, 3}, {0x08, 1}, {0x80, 4}, {0x01, 1}, {0x10, 3}, {0x20, 5}, {0x02, 1}}, // p % 30 == 23
+    {{0x80, 6}, {0x40, 4}, {0x20, 2}, {0x10, 4}, {0x08, 2}, {0x04, 4}, {0x02, 6}, {0x01, 1}}, // p % 30 == 29
+};
+
+uint64_t wheel_next_prime(const uint8_t *bits, uint64_t first_byte, uint64_t max, uint64_t k)
+{
+    if (k >= max) // also keeps k + 1 from wrapping around at 2^64 - 1
+        return 0;
+    for (uint64_t n = k + 1; n <= max && n < 7; n++)
+    {
+        if (wheel_is_prime(bits, first_byte, n))
+            return n;
+    }
+    if (k + 1 < 7)
+        k = 6;
+    uint64_t byte = (k + 1) / WHEEL_SPAN;
+    // drop the residues <= k of the first byte
+    uint8_t word = bits[byte - first_byte];
+    for (int i = 0; i < 8 && byte * WHEEL_SPAN + wheel_residues[i] <= k; i++)
+        word &= ~(1u << i);
+    uint64_t last = max / WHEEL_SPAN;
+    while (word == 0 && byte < last)
+        word = bits[++byte - first_byte];
+    if (word == 0)
+        return 0;
+    uint64_t n = byte * WHEEL_SPAN + wheel_residues[__builtin_ctz(word)];
+    return n <= max ? n : 0;
+}
+
+uint64_t wheel_count(const uint8_t *bits, uint64_t first_byte, uint64_t low, uint64_t high)
+{
+    if (low > high)
+        return 0;
+    uint64_t count = wheel_small_primes(low, high);
+    uint64_t first = low / WHEEL_SPAN;
+    uint64_t last = high / WHEEL_SPAN;
+    // keep the residues >= low in the first byte and <= high in the last one
+    uint8_t first_mask = 0xff, last_mask = 0xff;
+    for (int b = 0; b < 8; b++)
+    {
+        if (wheel_residues[b] < low % WHEEL_SPAN)
+            first_mask &= ~(1u << b);
+        if (wheel_residues[b] > high % WHEEL_SPAN)
+            last_mask &= ~(1u << b);
+    }
+    if (first == last)
+        return count + __builtin_popcount(bits[first - first_byte] & first_mask & last_mask);
+    count += __builtin_popcount(bits[first - first_byte] & first_mask);
+    count += popcount_bytes(bits + (first - first_byte) + 1, last - first - 1);
+    count += __builtin_popcount(bits[last - first_byte] & last_mask);
+    return count;
+}
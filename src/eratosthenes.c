@@ -1,11 +1,9 @@
-#include "timer.h"
+#include "sieve.h"
+#include "profile.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
-#include <string.h>
-#include <stdbool.h>
-#include <math.h>
 
 /**
  * @brief Sequential implementation of the Sieve of Erathostens
@@ -19,92 +17,33 @@ void usage(void)
     printf("[%s] Usage:\n", TAG);
     printf("./eratosthenes MAX\n");
     printf("\tWhere MAX: u64 maximum number\n");
-}
-
-static inline uint64_t square(uint64_t k)
-{
-    return k * k;
-}
-
-void mark(char *n_numbers, uint64_t max, uint64_t k)
-{
-    uint64_t kk = square(k);
-    for (uint64_t i = kk; i <= max; i++)
-    {
-        if (i % k == 0)
-            n_numbers[i] = true; // mark
-    }
-}
-
-void find_smallest(const char *n_numbers, uint64_t max, uint64_t *k)
-{
-    uint64_t i = (*k) + 1;
-    while (i != max)
-    {
-        if (!n_numbers[i])
-        { // unmarked
-            *k = i;
-            break;
-        }
-        i++;
-    }
-}
-
-void print_primes(const char *n_numbers, uint64_t max)
-{
-    if (max <= 100)
-    {
-        for (uint64_t i = 0; i < max; i++)
-        {
-            if (!n_numbers[i])
-                printf("%lu ", i);
-        }
-        printf("\n");
-    }
-    else
-    {
-        int count = 0;
-        for (uint64_t i = 0; i < max; i++)
-        {
-            if (!n_numbers[i])
-                count++;
-        }
-        printf("prime count: %d\n", count);
-    }
+    sieve_usage_options();
 }
 
 int main(int argc, char *argv[])
 {
-    uint64_t max = 0;
-    if (argc < 2)
+    sieve_config cfg;
+    sieve_config_init(&cfg);
+    cfg.backend = SIEVE_BACKEND_SEQUENTIAL;
+    if (sieve_parse_args(argc, argv, &cfg, false) != 0)
     {
         usage();
         exit(0);
     }
-    if (argc == 2)
-    {
-        max = strtoul(argv[1], NULL, 10);
-    }
-    printf("%lu\n", max);
-    // Create a list of natural numbers 1..Max
-    char *natural_numbers = (char *)calloc(max + 1, sizeof(char)); // Linux will not allocate the memory until it's used
-    // 0 (false) -> unmarked
-    // 1 (true) -> marked
-    memset(natural_numbers, false, max); // set all unmarked
+    // the primes may be streamed to stdout: keep it clean
+    FILE *info = cfg.output == SIEVE_OUTPUT_STREAM ? stderr : stdout;
+    fprintf(info, "%lu\n", cfg.max);
 
-    // BENCHMARK
-    double start, end;
-    GET_TIME(start);
-    uint64_t k = 2;
-    while (square(k) <= max)
+    sieve_result res;
+    if (sieve_run(&cfg, &res) != 0)
     {
-        mark(natural_numbers, max, k);
-        find_smallest(natural_numbers, max, &k);
+        printf("[%s] Error running the %s backend\n", TAG, sieve_backend_name(cfg.backend));
+        exit(1);
     }
-    GET_TIME(end);
-    printf("Elapsed: %lf\n", end - start);
+    fprintf(info, "Elapsed: %lf\n", res.elapsed);
 
-    print_primes(natural_numbers, max);
+    sieve_print_primes(&cfg, &res);
 
-    free(natural_numbers);
+    sieve_result_free(&res);
+    PROFILE_REPORT(stderr, 0);
 }
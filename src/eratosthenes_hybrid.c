@@ -0,0 +1,67 @@
+#include "sieve.h"
+#include "profile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <mpi.h>
+
+#define MASTER_NODE 0
+/**
+ * @brief Hybrid MPI + pthread implementation of the Sieve of Eratosthens
+ *
+ */
+
+const char *TAG = "MPI Hybrid";
+
+void usage(void)
+{
+    printf("[%s] Usage:\n", TAG);
+    printf("mpiexec --hostfile hosts --map-by ppr:1:node --bind-to none ./eratosthenes_hybrid MAX N\n");
+    printf("\tWhere:\n");
+    printf("\t\tMAX: u64 maximum number\n");
+    printf("\t\tN: number of threads per process (default: online cpus)\n");
+    sieve_usage_options();
+}
+
+int main(int argc, char *argv[])
+{
+    // Initialize MPI: only the main thread of each process communicates
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_set_errhandler(MPI_COMM_WORLD, MPI_ERRORS_ARE_FATAL); /* return info about errors */
+    // Check processors by printing them
+    char name[MPI_MAX_PROCESSOR_NAME];
+    int len = 0;
+    MPI_Get_processor_name(name, &len);
+    printf("[%d] %s\n", rank, name);
+
+    sieve_config cfg;
+    sieve_config_init(&cfg);
+    cfg.backend = SIEVE_BACKEND_MPI_HYBRID;
+    if (sieve_parse_args(argc, argv, &cfg, true) != 0)
+    {
+        if (rank == MASTER_NODE)
+            usage();
+        MPI_Finalize();
+        exit(0);
+    }
+
+    sieve_result res;
+    if (sieve_run(&cfg, &res) != 0)
+    {
+        printf("[%d] Error running the %s backend\n", rank, sieve_backend_name(cfg.backend));
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (rank == MASTER_NODE)
+    {
+        printf("Elapsed %f\n", res.elapsed);
+        sieve_print_primes(&cfg, &res);
+    }
+
+    sieve_result_free(&res);
+    PROFILE_REPORT(stderr, rank);
+    MPI_Finalize();
+}
@@ -0,0 +1,405 @@
+#include "sieve.h"
+#include "tune.h"
+#include "timer.h"
+#include "numbers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include <unistd.h>
+#ifdef SIEVE_HAVE_MPI
+#include <mpi.h>
+#endif
+
+#define MASTER_NODE 0
+/** Longest list of sizes, thread counts or backends */
+#define BENCH_MAX_LIST 32
+
+/**
+ * @brief Benchmark driver: the backends over a sweep of sizes and thread counts
+ *
+ * Every configuration is run warm-up times, then timed trials times with the
+ * monotonic clock of timer.h around sieve_run(). One row per configuration
+ * reports median, p95, mean, standard deviation and minimum of the trials,
+ * the numbers sieved per second and the bytes of packed sieve written per
+ * second, in CSV or JSON.
+ *
+ * Built against libsieve as sieve_bench (shared memory backends) and against
+ * libsieve_mpi as sieve_bench_mpi (MPI backends, the ranks come from mpirun).
+ */
+
+const char *TAG = "Bench";
+
+typedef struct
+{
+    sieve_backend backends[BENCH_MAX_LIST];
+    int n_backends;
+    uint64_t sizes[BENCH_MAX_LIST];
+    int n_sizes;
+    int threads[BENCH_MAX_LIST];
+    int n_threads;
+    int warmup;
+    int trials;
+    uint64_t segment_bytes;
+    bool json;
+    const char *output_path;
+    bool autotune;
+} bench_options;
+
+typedef struct
+{
+    double median;
+    double p95;
+    double mean;
+    double stddev;
+    double min;
+} bench_stats;
+
+void usage(void)
+{
+    printf("[%s] Usage:\n", TAG);
+#ifdef SIEVE_HAVE_MPI
+    printf("mpirun -np RANKS ./sieve_bench_mpi [OPTIONS]\n");
+#else
+    printf("./sieve_bench [OPTIONS]\n");
+#endif
+    printf("\tOptions:\n");
+    printf("\t\t--backends LIST: comma separated backends, every available one by default\n");
+    printf("\t\t--sizes LIST: comma separated MAX values, 1e7,1e8,1e9 by default\n");
+    printf("\t\t--threads LIST: comma separated thread counts, powers of 2 up to the online cpus by default\n");
+    printf("\t\t--warmup N: untimed runs before the trials (default 2)\n");
+    printf("\t\t--trials N: timed runs per configuration (default 10)\n");
+    printf("\t\t--segment BYTES: segment size in bytes (30 numbers each)\n");
+    printf("\t\t--format csv|json: output format (default csv)\n");
+    printf("\t\t--output FILE: write the results to FILE instead of stdout\n");
+#ifndef SIEVE_HAVE_MPI
+    printf("\t\t--autotune: calibrate segment size, threads and OpenMP chunks, save them for this machine\n");
+#endif
+}
+
+/**
+ * Split a comma separated list, calling add on every item
+ * @return 0 on success, -1 if an item is rejected or the list is too long
+ */
+static int parse_list(char *list, bench_options *opt, int (*add)(bench_options *, const char *))
+{
+    for (char *item = strtok(list, ","); item != NULL; item = strtok(NULL, ","))
+    {
+        if (add(opt, item) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int add_backend(bench_options *opt, const char *name)
+{
+    if (opt->n_backends == BENCH_MAX_LIST || sieve_backend_from_name(name, &opt->backends[opt->n_backends]) != 0 ||
+        !sieve_backend_available(opt->backends[opt->n_backends]))
+        return -1;
+    opt->n_backends++;
+    return 0;
+}
+
+static int add_size(bench_options *opt, const char *size)
+{
+    if (opt->n_sizes == BENCH_MAX_LIST || numbers_parse(size, &opt->sizes[opt->n_sizes]) != 0)
+        return -1;
+    opt->n_sizes++;
+    return 0;
+}
+
+static int add_threads(bench_options *opt, const char *threads)
+{
+    if (opt->n_threads == BENCH_MAX_LIST || atoi(threads) <= 0)
+        return -1;
+    opt->threads[opt->n_threads++] = atoi(threads);
+    return 0;
+}
+
+#ifdef SIEVE_HAVE_MPI
+static bool is_mpi(sieve_backend backend)
+{
+    return backend == SIEVE_BACKEND_MPI || backend == SIEVE_BACKEND_MPI_COLLECTIVE || backend == SIEVE_BACKEND_MPI_HYBRID;
+}
+#endif
+
+static int parse_options(int argc, char *argv[], bench_options *opt)
+{
+    static const struct option long_options[] = {
+        {"backends", required_argument, NULL, 'b'},
+        {"sizes", required_argument, NULL, 'n'},
+        {"threads", required_argument, NULL, 't'},
+        {"warmup", required_argument, NULL, 'w'},
+        {"trials", required_argument, NULL, 'r'},
+        {"segment", required_argument, NULL, 's'},
+        {"format", required_argument, NULL, 'f'},
+        {"output", required_argument, NULL, 'o'},
+        {"autotune", no_argument, NULL, 'a'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+    memset(opt, 0, sizeof(*opt));
+    opt->warmup = 2;
+    opt->trials = 10;
+    int c;
+    while ((c = getopt_long(argc, argv, "b:n:t:w:r:s:f:o:ah", long_options, NULL)) != -1)
+    {
+        int ret = 0;
+        switch (c)
+        {
+        case 'b':
+            ret = parse_list(optarg, opt, add_backend);
+            break;
+        case 'n':
+            ret = parse_list(optarg, opt, add_size);
+            break;
+        case 't':
+            ret = parse_list(optarg, opt, add_threads);
+            break;
+        case 'w':
+            opt->warmup = atoi(optarg);
+            break;
+        case 'r':
+            opt->trials = atoi(optarg);
+            break;
+        case 's':
+            opt->segment_bytes = strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            if (strcmp(optarg, "json") != 0 && strcmp(optarg, "csv") != 0)
+                return -1;
+            opt->json = strcmp(optarg, "json") == 0;
+            break;
+        case 'o':
+            opt->output_path = optarg;
+            break;
+#ifndef SIEVE_HAVE_MPI
+        case 'a':
+            opt->autotune = true;
+            break;
+#endif
+        case 'h': // usage
+        default:
+            return -1;
+        }
+        if (ret != 0)
+            return -1;
+    }
+    if (optind != argc || opt->warmup < 0 || opt->trials <= 0)
+        return -1;
+    bool has_backends = opt->n_backends > 0;
+
+    // defaults: the backends of this binary, three sizes, powers of 2 up to the cpus
+    for (int b = 0; !has_backends && b < SIEVE_BACKEND_COUNT; b++)
+    {
+#ifdef SIEVE_HAVE_MPI
+        if (sieve_backend_available((sieve_backend)b) && is_mpi((sieve_backend)b))
+#else
+        if (sieve_backend_available((sieve_backend)b))
+#endif
+            opt->backends[opt->n_backends++] = (sieve_backend)b;
+    }
+    if (opt->n_sizes == 0)
+    {
+        opt->sizes[opt->n_sizes++] = 10000000;
+        opt->sizes[opt->n_sizes++] = 100000000;
+        opt->sizes[opt->n_sizes++] = 1000000000;
+    }
+    if (opt->n_threads == 0)
+    {
+        int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        for (int t = 1; t < cpus && opt->n_threads < BENCH_MAX_LIST - 1; t *= 2)
+            opt->threads[opt->n_threads++] = t;
+        opt->threads[opt->n_threads++] = cpus;
+    }
+    return 0;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Statistics of the trials, sorts times
+ */
+static bench_stats compute_stats(double *times, int n)
+{
+    bench_stats st;
+    qsort(times, n, sizeof(double), compare_double);
+    st.min = times[0];
+    st.median = n % 2 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+    st.p95 = times[(int)ceil(0.95 * n) - 1]; // nearest rank
+    double sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += times[i];
+    st.mean = sum / n;
+    double var = 0;
+    for (int i = 0; i < n; i++)
+        var += (times[i] - st.mean) * (times[i] - st.mean);
+    st.stddev = n > 1 ? sqrt(var / (n - 1)) : 0;
+    return st;
+}
+
+/**
+ * Calibrate this machine and save its profile, which sieve_run() applies from then on
+ */
+static int autotune(void)
+{
+    tune_profile profile;
+    char path[512];
+    if (tune_calibrate(&profile, stderr) != 0)
+    {
+        printf("[%s] Calibration run failed\n", TAG);
+        return -1;
+    }
+    printf("segment_bytes=%lu threads=%d chunks_per_thread=%d\n", profile.segment_bytes, profile.n_threads,
+           profile.chunks_per_thread);
+    if (tune_save(&profile) != 0 || tune_path(path, sizeof(path)) != 0)
+    {
+        printf("[%s] Could not save the profile, set SIEVE_TUNE_FILE\n", TAG);
+        return -1;
+    }
+    printf("[%s] Profile saved to %s\n", TAG, path);
+    return 0;
+}
+
+/**
+ * Warm up then time the trials of one configuration
+ * @return 0 on success, -1 if the backend failed
+ */
+static int bench_run(const bench_options *opt, sieve_backend backend, uint64_t max, int threads, double *times,
+                     uint64_t *count)
+{
+    sieve_config cfg;
+    sieve_config_init(&cfg);
+    cfg.backend = backend;
+    cfg.max = max;
+    cfg.n_threads = threads;
+    cfg.segment_bytes = opt->segment_bytes;
+    cfg.output = SIEVE_OUTPUT_COUNT;
+    for (int i = 0; i < opt->warmup + opt->trials; i++)
+    {
+#ifdef SIEVE_HAVE_MPI
+        // every rank starts together, the master stops once it has the result
+        MPI_Barrier(MPI_COMM_WORLD);
+#endif
+        double start, end;
+        sieve_result res;
+        GET_TIME(start);
+        int ret = sieve_run(&cfg, &res);
+        GET_TIME(end);
+        if (ret != 0)
+            return -1;
+        *count = res.count;
+        sieve_result_free(&res);
+        if (i >= opt->warmup)
+            times[i - opt->warmup] = end - start;
+    }
+    return 0;
+}
+
+static void print_row(FILE *out, const bench_options *opt, bool first, sieve_backend backend, uint64_t max,
+                      int threads, int ranks, uint64_t count, const bench_stats *st)
+{
+    double numbers_per_s = (double)max / st->median;
+    double gb_per_s = (double)(max / 30 + 1) / st->median / 1e9;
+    if (opt->json)
+    {
+        fprintf(out, "%s  {\"backend\": \"%s\", \"max\": %lu, \"threads\": %d, \"ranks\": %d, \"trials\": %d, "
+                     "\"count\": %lu, \"median_s\": %.9f, \"p95_s\": %.9f, \"mean_s\": %.9f, \"stddev_s\": %.9f, "
+                     "\"min_s\": %.9f, \"numbers_per_s\": %.6e, \"bitset_gb_per_s\": %.6f}",
+                first ? "" : ",\n", sieve_backend_name(backend), max, threads, ranks, opt->trials, count, st->median,
+                st->p95, st->mean, st->stddev, st->min, numbers_per_s, gb_per_s);
+    }
+    else
+    {
+        if (first)
+            fprintf(out, "backend,max,threads,ranks,trials,count,median_s,p95_s,mean_s,stddev_s,min_s,"
+                         "numbers_per_s,bitset_gb_per_s\n");
+        fprintf(out, "%s,%lu,%d,%d,%d,%lu,%.9f,%.9f,%.9f,%.9f,%.9f,%.6e,%.6f\n", sieve_backend_name(backend), max,
+                threads, ranks, opt->trials, count, st->median, st->p95, st->mean, st->stddev, st->min,
+                numbers_per_s, gb_per_s);
+    }
+    fflush(out);
+}
+
+int main(int argc, char *argv[])
+{
+    int rank = MASTER_NODE, ranks = 1;
+#ifdef SIEVE_HAVE_MPI
+    // the hybrid backend runs threads next to MPI
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+    MPI_Comm_set_errhandler(MPI_COMM_WORLD, MPI_ERRORS_ARE_FATAL);
+#endif
+    bench_options opt;
+    if (parse_options(argc, argv, &opt) != 0)
+    {
+        if (rank == MASTER_NODE)
+            usage();
+#ifdef SIEVE_HAVE_MPI
+        MPI_Finalize();
+#endif
+        exit(0);
+    }
+    if (opt.autotune)
+        return autotune() == 0 ? 0 : 1;
+    FILE *out = stdout;
+    if (rank == MASTER_NODE && opt.output_path != NULL && (out = fopen(opt.output_path, "w")) == NULL)
+    {
+        perror(opt.output_path);
+        exit(1);
+    }
+    double *times = (double *)malloc(opt.trials * sizeof(double));
+    if (times == NULL)
+        exit(1);
+
+    bool first = true;
+    if (rank == MASTER_NODE && opt.json)
+        fprintf(out, "[\n");
+    for (int b = 0; b < opt.n_backends; b++)
+    {
+        sieve_backend backend = opt.backends[b];
+        // only the pthread, OpenMP and hybrid backends use the thread count
+        bool threaded = backend == SIEVE_BACKEND_PTHREAD || backend == SIEVE_BACKEND_OPENMP ||
+                        backend == SIEVE_BACKEND_MPI_HYBRID;
+        for (int n = 0; n < opt.n_sizes; n++)
+        {
+            for (int t = 0; t < (threaded ? opt.n_threads : 1); t++)
+            {
+                int threads = threaded ? opt.threads[t] : 1;
+                uint64_t count = 0;
+                if (bench_run(&opt, backend, opt.sizes[n], threads, times, &count) != 0)
+                {
+                    printf("[%d] Error running the %s backend\n", rank, sieve_backend_name(backend));
+#ifdef SIEVE_HAVE_MPI
+                    MPI_Abort(MPI_COMM_WORLD, 1);
+#endif
+                    exit(1);
+                }
+                if (rank != MASTER_NODE)
+                    continue;
+                bench_stats st = compute_stats(times, opt.trials);
+                fprintf(stderr, "[%s] %s max=%lu threads=%d ranks=%d: median %f s, p95 %f s\n", TAG,
+                        sieve_backend_name(backend), opt.sizes[n], threads, ranks, st.median, st.p95);
+                print_row(out, &opt, first, backend, opt.sizes[n], threads, ranks, count, &st);
+                first = false;
+            }
+        }
+    }
+    if (rank == MASTER_NODE && opt.json)
+        fprintf(out, "\n]\n");
+    if (out != stdout)
+        fclose(out);
+    free(times);
+#ifdef SIEVE_HAVE_MPI
+    MPI_Finalize();
+#endif
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "primality.h"
+#include "numbers.h"
+#include "timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+
+/**
+ * @brief Batch primality: classify every 64 bit number of a file or of stdin
+ *
+ * The numbers are decimal, separated by white space (numbers.h). Prints one
+ * line per number in input order, 1 if it is prime and 0 otherwise, or with
+ * --primes only the numbers that are prime.
+ */
+
+const char *TAG = "Classify";
+
+void usage(void)
+{
+    printf("[%s] Usage:\n", TAG);
+    printf("./sieve_classify [OPTIONS] [FILE]\n");
+    printf("\tWhere FILE: decimal numbers to test, stdin by default\n");
+    printf("\tOptions:\n");
+    printf("\t\t--threads N: threads, the online cpus by default\n");
+    printf("\t\t--primes: print the primes only instead of 0 or 1 per number\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option long_options[] = {
+        {"threads", required_argument, NULL, 't'},
+        {"primes", no_argument, NULL, 'p'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+    int n_threads = 0;
+    bool primes_only = false;
+    int c;
+    while ((c = getopt_long(argc, argv, "t:ph", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 't':
+            n_threads = atoi(optarg);
+            break;
+        case 'p':
+            primes_only = true;
+            break;
+        case 'h': // usage
+        default:
+            usage();
+            exit(0);
+        }
+    }
+    if (argc - optind > 1 || n_threads < 0)
+    {
+        usage();
+        exit(0);
+    }
+    FILE *f = optind < argc ? fopen(argv[optind], "r") : stdin;
+    if (f == NULL)
+    {
+        printf("[%s] Could not open %s\n", TAG, argv[optind]);
+        exit(1);
+    }
+    uint64_t *numbers;
+    size_t n;
+    if (numbers_read(f, &numbers, &n) != 0)
+    {
+        printf("[%s] Could not read the numbers: decimal, at most 64 bits, separated by white space\n", TAG);
+        exit(1);
+    }
+    if (f != stdin)
+        fclose(f);
+
+    bool *results = (bool *)malloc(n + 1);
+    double start, end;
+    GET_TIME(start);
+    if (results == NULL || prime_test_batch(numbers, n, results, n_threads) != 0)
+    {
+        printf("[%s] Out of memory\n", TAG);
+        exit(1);
+    }
+    GET_TIME(end);
+
+    size_t n_primes = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        n_primes += results[i];
+        if (!primes_only)
+            fputs(results[i] ? "1\n" : "0\n", stdout);
+        else if (results[i])
+            printf("%lu\n", numbers[i]);
+    }
+    fprintf(stderr, "[%s] %zu numbers, %zu primes, %lf s (%.3e tests/s)\n", TAG, n, n_primes, end - start,
+            (end - start) > 0 ? n / (end - start) : 0.0);
+    free(results);
+    free(numbers);
+}
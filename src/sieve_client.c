@@ -0,0 +1,106 @@
+#include "server.h"
+#include "numbers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @brief Command line client of sieve_daemon: every query of the command line in one batch
+ *
+ * Prints one line per query: the answer, or the primes separated by spaces.
+ */
+
+const char *TAG = "Client";
+
+void usage(void)
+{
+    printf("[%s] Usage:\n", TAG);
+    printf("./sieve_client [--socket PATH] QUERY...\n");
+    printf("\tWhere QUERY is one of:\n");
+    printf("\t\tis_prime N\n");
+    printf("\t\tnext_prime N: smallest prime > N\n");
+    printf("\t\tcount LO HI: primes in [LO, HI]\n");
+    printf("\t\tprimes LO HI: list of the primes in [LO, HI]\n");
+}
+
+/**
+ * @return number of queries, -1 on a syntax error
+ */
+static int parse_queries(int argc, char *argv[], server_query *queries)
+{
+    static const struct
+    {
+        const char *name;
+        server_op op;
+        int n_args;
+    } ops[] = {{"is_prime", SERVER_IS_PRIME, 1},
+               {"next_prime", SERVER_NEXT_PRIME, 1},
+               {"count", SERVER_COUNT, 2},
+               {"primes", SERVER_PRIMES, 2}};
+    int n = 0;
+    for (int i = 0; i < argc;)
+    {
+        int k = 0;
+        while (k < 4 && strcmp(argv[i], ops[k].name) != 0)
+            k++;
+        if (k == 4 || i + ops[k].n_args >= argc)
+            return -1;
+        memset(&queries[n], 0, sizeof(server_query));
+        queries[n].op = ops[k].op;
+        if (numbers_parse(argv[i + 1], &queries[n].lo) != 0 ||
+            (ops[k].n_args == 2 && numbers_parse(argv[i + 2], &queries[n].hi) != 0))
+            return -1;
+        i += 1 + ops[k].n_args;
+        n++;
+    }
+    return n;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = SERVER_SOCKET_DEFAULT;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "--socket") == 0)
+    {
+        path = argv[2];
+        first = 3;
+    }
+    server_query *queries = (server_query *)malloc(sizeof(server_query) * (argc + 1));
+    server_answer *answers = (server_answer *)malloc(sizeof(server_answer) * (argc + 1));
+    int n = queries == NULL || answers == NULL ? -1 : parse_queries(argc - first, argv + first, queries);
+    if (n <= 0)
+    {
+        usage();
+        exit(0);
+    }
+    int fd = server_connect(path);
+    if (fd < 0)
+    {
+        printf("[%s] Could not connect to %s\n", TAG, path);
+        exit(1);
+    }
+    uint64_t *storage;
+    if (server_call(fd, queries, n, answers, &storage) != 0)
+    {
+        printf("[%s] Request failed\n", TAG);
+        exit(1);
+    }
+    for (int i = 0; i < n; i++)
+    {
+        if (answers[i].status != SERVER_OK)
+        {
+            printf("error %d\n", answers[i].status);
+            continue;
+        }
+        for (uint64_t k = 0; k < answers[i].n_values; k++)
+            printf(k == 0 ? "%lu" : " %lu", answers[i].values[k]);
+        printf("\n");
+    }
+    free(storage);
+    free(answers);
+    free(queries);
+    close(fd);
+}
@@ -0,0 +1,89 @@
+#include "server.h"
+#include "numbers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+
+/**
+ * @brief Prime query daemon: keeps the base primes and recent blocks in memory (server.h)
+ *
+ * Runs in the foreground until SIGINT or SIGTERM; sieve_client or any client
+ * of the protocol of server.h sends it batches of queries.
+ */
+
+const char *TAG = "Daemon";
+
+void usage(void)
+{
+    printf("[%s] Usage:\n", TAG);
+    printf("./sieve_daemon [OPTIONS]\n");
+    printf("\tOptions:\n");
+    printf("\t\t--socket PATH: Unix socket to listen on (default %s)\n", SERVER_SOCKET_DEFAULT);
+    printf("\t\t--threads N: worker threads, the online cpus by default\n");
+    printf("\t\t--limit N: largest number sieved, the base primes go up to its square root (default 1e16)\n");
+    printf("\t\t--lmo-max N: largest HI of a count answered with LMO, past the limit (default 1e14)\n");
+    printf("\t\t--cache N: sieved blocks of %d bytes kept in memory (default %d)\n", SERVER_BLOCK_BYTES,
+           SERVER_CACHE_BLOCKS);
+}
+
+static int parse_options(int argc, char *argv[], server_config *cfg)
+{
+    static const struct option long_options[] = {
+        {"socket", required_argument, NULL, 's'},
+        {"threads", required_argument, NULL, 't'},
+        {"limit", required_argument, NULL, 'l'},
+        {"lmo-max", required_argument, NULL, 'm'},
+        {"cache", required_argument, NULL, 'c'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+    int c;
+    while ((c = getopt_long(argc, argv, "s:t:l:m:c:h", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 's':
+            cfg->socket_path = optarg;
+            break;
+        case 't':
+            cfg->n_threads = atoi(optarg);
+            break;
+        case 'l':
+            if (numbers_parse(optarg, &cfg->limit) != 0)
+                return -1;
+            break;
+        case 'm':
+            if (numbers_parse(optarg, &cfg->lmo_max) != 0)
+                return -1;
+            break;
+        case 'c':
+            if (numbers_parse(optarg, &cfg->cache_blocks) != 0)
+                return -1;
+            break;
+        case 'h': // usage
+        default:
+            return -1;
+        }
+    }
+    return optind == argc && cfg->n_threads >= 0 && cfg->cache_blocks > 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    server_config cfg;
+    server_config_init(&cfg);
+    if (parse_options(argc, argv, &cfg) != 0)
+    {
+        usage();
+        exit(0);
+    }
+    fprintf(stderr, "[%s] Listening on %s\n", TAG, cfg.socket_path);
+    if (server_run(&cfg) != 0)
+    {
+        printf("[%s] Could not start the server\n", TAG);
+        exit(1);
+    }
+    fprintf(stderr, "[%s] Stopped\n", TAG);
+}
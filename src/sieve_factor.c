@@ -0,0 +1,131 @@
+#include "spf.h"
+#include "numbers.h"
+#include "timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+
+/**
+ * @brief Bulk factorization of the numbers of a file or of stdin
+ *
+ * The numbers are decimal, separated by white space (numbers.h). A smallest
+ * prime factor table is built up to the largest of them (or --limit), then
+ * every number is printed with its prime factors, "n: p q q r", in input order.
+ * A number that has no factorization, 0, is printed "0: error" and the exit
+ * status is 1.
+ */
+
+const char *TAG = "Factor";
+
+void usage(void)
+{
+    printf("[%s] Usage:\n", TAG);
+    printf("./sieve_factor [OPTIONS] [FILE]\n");
+    printf("\tWhere FILE: decimal numbers to factor, at most %lu, stdin by default\n", SPF_MAX_LIMIT);
+    printf("\tOptions:\n");
+    printf("\t\t--threads N: threads, the online cpus by default\n");
+    printf("\t\t--limit L: build the table up to L instead of the largest number\n");
+    printf("\t\t--quiet: print the timings only\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option long_options[] = {
+        {"threads", required_argument, NULL, 't'},
+        {"limit", required_argument, NULL, 'l'},
+        {"quiet", no_argument, NULL, 'q'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+    int n_threads = 0;
+    uint64_t limit = 0;
+    bool quiet = false;
+    int c;
+    while ((c = getopt_long(argc, argv, "t:l:qh", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 't':
+            n_threads = atoi(optarg);
+            break;
+        case 'l':
+            limit = strtoul(optarg, NULL, 10);
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        case 'h': // usage
+        default:
+            usage();
+            exit(0);
+        }
+    }
+    if (argc - optind > 1 || n_threads < 0)
+    {
+        usage();
+        exit(0);
+    }
+    FILE *f = optind < argc ? fopen(argv[optind], "r") : stdin;
+    if (f == NULL)
+    {
+        printf("[%s] Could not open %s\n", TAG, argv[optind]);
+        exit(1);
+    }
+    uint64_t *numbers;
+    size_t n;
+    if (numbers_read(f, &numbers, &n) != 0)
+    {
+        printf("[%s] Could not read the numbers: decimal, at most 64 bits, separated by white space\n", TAG);
+        exit(1);
+    }
+    if (f != stdin)
+        fclose(f);
+    for (size_t i = 0; i < n; i++)
+        limit = numbers[i] > limit ? numbers[i] : limit;
+    if (limit > SPF_MAX_LIMIT)
+    {
+        printf("[%s] %lu is past the largest table, %lu\n", TAG, limit, SPF_MAX_LIMIT);
+        exit(1);
+    }
+
+    spf_table table;
+    spf_factorization *factors = (spf_factorization *)malloc((n + 1) * sizeof(spf_factorization));
+    double start, built, end;
+    GET_TIME(start);
+    if (factors == NULL || spf_table_init(&table, limit, n_threads) != 0)
+    {
+        printf("[%s] Out of memory\n", TAG);
+        exit(1);
+    }
+    GET_TIME(built);
+    size_t failed = spf_factor_batch(&table, numbers, n, factors, n_threads);
+    GET_TIME(end);
+
+    for (size_t i = 0; !quiet && i < n; i++)
+    {
+        printf("%lu:", numbers[i]);
+        // 1 has no factor either, but it is factored
+        if (factors[i].n_factors == 0 && numbers[i] != 1)
+        {
+            printf(" error\n");
+            continue;
+        }
+        for (int k = 0; k < factors[i].n_factors; k++)
+        {
+            for (unsigned e = 0; e < factors[i].exponents[k]; e++)
+                printf(" %lu", factors[i].primes[k]);
+        }
+        printf("\n");
+    }
+    fprintf(stderr, "[%s] %zu numbers, table up to %lu in %lf s, factored in %lf s (%.3e numbers/s)\n", TAG, n,
+            limit, built - start, end - built, (end - built) > 0 ? n / (end - built) : 0.0);
+    if (failed > 0)
+        fprintf(stderr, "[%s] %zu numbers could not be factored\n", TAG, failed);
+    spf_table_free(&table);
+    free(factors);
+    free(numbers);
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,205 @@
+#include "lazy.h"
+#include "primality.h"
+#include "timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/**
+ * @brief Concurrent readers of a lazy sieve, with or without extender threads
+ *
+ * Each reader asks --queries questions about random numbers below a bound
+ * that grows from 0 to MAX as it goes, the way the demand of a service
+ * grows: is_prime, and next_prime every 16th query. Extender threads, if
+ * any, sieve ahead up to MAX meanwhile. With --verify every answer is
+ * checked against prime_test().
+ */
+
+const char *TAG = "Lazy";
+/** One query out of this many is a next_prime, the others are is_prime */
+#define NEXT_PRIME_EVERY 16
+
+typedef struct
+{
+    lazy_sieve *sieve;
+    uint64_t max;
+    uint64_t queries;
+    uint64_t seed;
+    bool verify;
+    uint64_t primes; // answers that are prime
+    uint64_t errors; // failed or wrong answers
+} reader;
+
+typedef struct
+{
+    lazy_sieve *sieve;
+    uint64_t max;
+    int failed;
+} extender;
+
+void usage(void)
+{
+    printf("[%s] Usage:\n", TAG);
+    printf("./sieve_lazy [OPTIONS] MAX\n");
+    printf("\tWhere MAX: u64 bound of the queries, at most %lu\n", LAZY_MAX);
+    printf("\tOptions:\n");
+    printf("\t\t--readers N: reader threads, the online cpus by default\n");
+    printf("\t\t--extenders N: threads sieving ahead of the readers up to MAX (default 0)\n");
+    printf("\t\t--queries N: queries per reader (default 1000000)\n");
+    printf("\t\t--verify: check every answer with prime_test()\n");
+}
+
+static inline uint64_t xorshift(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void *read_queries(void *arg)
+{
+    reader *r = (reader *)arg;
+    uint64_t state = r->seed;
+    for (uint64_t q = 0; q < r->queries; q++)
+    {
+        // the bound grows with the queries: the early ones stay in the first segments
+        uint64_t bound = (uint64_t)((double)r->max * (q + 1) / r->queries);
+        uint64_t n = bound > 0 ? xorshift(&state) % bound : 0;
+        if (q % NEXT_PRIME_EVERY == 0)
+        {
+            uint64_t p = lazy_sieve_next_prime(r->sieve, n);
+            bool wrong = p <= n || (r->verify && !prime_test(p));
+            for (uint64_t m = n + 1; r->verify && !wrong && m < p; m++)
+                wrong = prime_test(m);
+            r->errors += wrong;
+            r->primes += !wrong;
+        }
+        else
+        {
+            int prime = lazy_sieve_is_prime(r->sieve, n);
+            r->errors += prime < 0 || (r->verify && prime != prime_test(n));
+            r->primes += prime == 1;
+        }
+    }
+    return NULL;
+}
+
+static void *extend(void *arg)
+{
+    extender *e = (extender *)arg;
+    e->failed = lazy_sieve_extend(e->sieve, e->max);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option long_options[] = {
+        {"readers", required_argument, NULL, 'r'},
+        {"extenders", required_argument, NULL, 'e'},
+        {"queries", required_argument, NULL, 'q'},
+        {"verify", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+    int n_readers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int n_extenders = 0;
+    uint64_t queries = 1000000;
+    bool verify = false;
+    int c;
+    while ((c = getopt_long(argc, argv, "r:e:q:vh", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 'r':
+            n_readers = atoi(optarg);
+            break;
+        case 'e':
+            n_extenders = atoi(optarg);
+            break;
+        case 'q':
+            queries = strtoul(optarg, NULL, 10);
+            break;
+        case 'v':
+            verify = true;
+            break;
+        case 'h': // usage
+        default:
+            usage();
+            exit(0);
+        }
+    }
+    if (argc - optind != 1 || n_readers < 1 || n_extenders < 0)
+    {
+        usage();
+        exit(0);
+    }
+    uint64_t max = strtoul(argv[optind], NULL, 10);
+    if (max > LAZY_MAX)
+    {
+        printf("[%s] MAX is past %lu\n", TAG, LAZY_MAX);
+        exit(1);
+    }
+
+    lazy_sieve sieve;
+    pthread_t *threads = (pthread_t *)malloc((n_readers + n_extenders) * sizeof(pthread_t));
+    reader *readers = (reader *)calloc(n_readers, sizeof(reader));
+    extender *extenders = (extender *)calloc(n_extenders + 1, sizeof(extender));
+    if (threads == NULL || readers == NULL || extenders == NULL || lazy_sieve_init(&sieve) != 0)
+    {
+        printf("[%s] Out of memory\n", TAG);
+        exit(1);
+    }
+    double start, end;
+    GET_TIME(start);
+    for (int i = 0; i < n_extenders; i++)
+    {
+        extenders[i] = (extender){.sieve = &sieve, .max = max};
+        if (pthread_create(&threads[n_readers + i], NULL, extend, &extenders[i]) != 0)
+        {
+            printf("[%s] Could not start the extenders\n", TAG);
+            exit(1);
+        }
+    }
+    for (int i = 0; i < n_readers; i++)
+    {
+        readers[i] = (reader){.sieve = &sieve, .max = max, .queries = queries, .seed = 0x9e3779b97f4a7c15ull * (i + 1),
+                              .verify = verify};
+        if (pthread_create(&threads[i], NULL, read_queries, &readers[i]) != 0)
+        {
+            printf("[%s] Could not start the readers\n", TAG);
+            exit(1);
+        }
+    }
+    uint64_t primes = 0, errors = 0;
+    for (int i = 0; i < n_readers; i++)
+    {
+        pthread_join(threads[i], NULL);
+        primes += readers[i].primes;
+        errors += readers[i].errors;
+    }
+    GET_TIME(end);
+    for (int i = 0; i < n_extenders; i++)
+    {
+        pthread_join(threads[n_readers + i], NULL);
+        errors += extenders[i].failed != 0;
+    }
+
+    uint64_t sieved = atomic_load(&sieve.sieved);
+    printf("[%s] %d readers, %d extenders: %lu queries in %lf s (%.3e queries/s), %lu primes\n", TAG, n_readers,
+           n_extenders, queries * n_readers, end - start, (end - start) > 0 ? queries * n_readers / (end - start) : 0.0,
+           primes);
+    printf("[%s] %lu segments sieved (%lu KB), sieved without a gap up to %lu\n", TAG, sieved,
+           sieved * sizeof(lazy_segment) / 1024, lazy_sieve_limit(&sieve));
+    if (errors > 0)
+        printf("[%s] %lu wrong or failed answers\n", TAG, errors);
+    lazy_sieve_free(&sieve);
+    free(extenders);
+    free(readers);
+    free(threads);
+    return errors > 0;
+}
@@ -0,0 +1,85 @@
+#include "wheel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+/**
+ * @brief Generator of the pre-sieve pattern compiled into libsieve
+ *
+ * The multiples of the primes from 7 up to LARGEST repeat every
+ * 7 * 11 * ... * LARGEST wheel bytes, since that product is coprime to 30.
+ * This writes that period as a C header, laid out with the residues of
+ * wheel.h, so that sieve_segment() starts each segment from a copy of it
+ * instead of crossing those primes off one by one.
+ *
+ * Usage: ./presieve_gen [LARGEST] > presieve_pattern.h
+ */
+
+#define LARGEST_DEFAULT 19
+/** Keeps the pattern small enough to stay in the L2 cache, 23 would make it 7 MB */
+#define LARGEST_MAX 19
+
+static int is_prime(unsigned n)
+{
+    for (unsigned d = 2; d * d <= n; d++)
+    {
+        if (n % d == 0)
+            return 0;
+    }
+    return n > 1;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned largest = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : LARGEST_DEFAULT;
+    if (largest < 7 || largest > LARGEST_MAX)
+    {
+        fprintf(stderr, "presieve_gen: LARGEST must be in [7, %d]\n", LARGEST_MAX);
+        return 1;
+    }
+    unsigned primes[8];
+    int n_primes = 0;
+    uint64_t period = 1;
+    for (unsigned p = 7; p <= largest; p++)
+    {
+        if (is_prime(p))
+        {
+            primes[n_primes++] = p;
+            period *= p;
+        }
+    }
+
+    printf("/* Generated by tools/presieve_gen.c, do not edit */\n");
+    printf("#ifndef _PRESIEVE_PATTERN_H_\n#define _PRESIEVE_PATTERN_H_\n\n#include <stdint.h>\n\n");
+    printf("/** Largest prime crossed off by the pattern, the smaller ones down to 7 are too */\n");
+    printf("#define PRESIEVE_LARGEST_PRIME %u\n", primes[n_primes - 1]);
+    printf("/** Period of the pattern in wheel bytes */\n");
+    printf("#define PRESIEVE_BYTES %" PRIu64 "u\n", period);
+
+    // the primes themselves are crossed off in the pattern: byte 0 puts them back
+    unsigned primes_mask = 0;
+    for (int i = 0; i < n_primes; i++)
+        primes_mask |= wheel_bit[primes[i] % WHEEL_SPAN];
+    printf("/** Bits of the pattern primes in wheel byte 0 */\n");
+    printf("#define PRESIEVE_PRIMES_MASK 0x%02x\n\n", primes_mask);
+
+    printf("static const uint8_t presieve_pattern[PRESIEVE_BYTES] = {");
+    for (uint64_t byte = 0; byte < period; byte++)
+    {
+        uint8_t bits = 0xff;
+        for (int b = 0; b < 8; b++)
+        {
+            uint64_t n = byte * WHEEL_SPAN + wheel_residues[b];
+            for (int i = 0; i < n_primes; i++)
+            {
+                if (n % primes[i] == 0)
+                    bits &= ~(1u << b);
+            }
+        }
+        printf("%s0x%02x,", byte % 16 == 0 ? "\n    " : " ", bits);
+    }
+    printf("\n};\n\n#endif\n");
+    return 0;
+}